@@ -0,0 +1,98 @@
+/**
+ * Picks the OSC sample rate from how hard the performer is moving and how
+ * well the link is coping.
+ *
+ * Motion is measured the way playMelodyNote() does it: totalAcc (m/s^2) and
+ * totalSpin (rad/s) over the x/y axes. The loudest sample since the last
+ * update sets the motion energy (0..1), which rises at once and decays
+ * gradually, and maps linearly onto floor..ceiling.
+ *
+ * The link caps that rate AIMD-style: a window with more than 5% failed
+ * datagrams, or an RSSI below ADAPTIVE_RATE_WEAK_RSSI, halves the cap, and
+ * every clean window raises it by a tenth of the ceiling again.
+ */
+#ifndef ADAPTIVE_RATE_H
+#define ADAPTIVE_RATE_H
+
+#include <stdint.h>
+
+#ifndef ADAPTIVE_RATE_FULL_ACC
+#define ADAPTIVE_RATE_FULL_ACC 3.0f // totalAcc (m/s^2) that asks for the ceiling rate
+#endif
+#ifndef ADAPTIVE_RATE_FULL_SPIN
+#define ADAPTIVE_RATE_FULL_SPIN 4.0f // totalSpin (rad/s) that asks for the ceiling rate
+#endif
+#ifndef ADAPTIVE_RATE_WEAK_RSSI
+#define ADAPTIVE_RATE_WEAK_RSSI -78 // dBm
+#endif
+#define ADAPTIVE_RATE_STEP_HZ 10 // rates are rounded to this, so small wobbles do not restart the sampler
+
+class AdaptiveRate {
+public:
+  AdaptiveRate(uint32_t floorHz, uint32_t ceilingHz)
+    : _floorHz(floorHz), _ceilingHz(ceilingHz), _capHz(ceilingHz), _rateHz(floorHz),
+      _energy(0), _peak(0), _lastPackets(0), _lastFailures(0), _congested(false) {}
+
+  /**
+   * @brief Feeds one sample's motion; only the peak since the last update() counts.
+   */
+  void addMotion(float totalAcc, float totalSpin) {
+    float e = totalAcc / ADAPTIVE_RATE_FULL_ACC;
+    float spin = totalSpin / ADAPTIVE_RATE_FULL_SPIN;
+    if (spin > e) e = spin;
+    if (e > _peak) _peak = e;
+  }
+
+  /**
+   * @brief Closes a measurement window and computes the new rate.
+   *
+   * @param packets  Cumulative datagrams sent successfully.
+   * @param failures Cumulative datagrams that failed.
+   * @param rssi     Current RSSI in dBm, 0 if unknown.
+   * @return The rate to sample at, in Hz.
+   */
+  uint32_t update(uint32_t packets, uint32_t failures, int rssi) {
+    float e = _peak > 1 ? 1 : _peak;
+    _peak = 0;
+    if (e > _energy) _energy = e;
+    else _energy += (e - _energy) * 0.2f;
+
+    uint32_t sent = packets - _lastPackets;
+    uint32_t failed = failures - _lastFailures;
+    _lastPackets = packets;
+    _lastFailures = failures;
+    _congested = (failed * 20 > sent + failed) || (rssi != 0 && rssi < ADAPTIVE_RATE_WEAK_RSSI);
+    if (_congested) {
+      _capHz /= 2;
+      if (_capHz < _floorHz) _capHz = _floorHz;
+    } else {
+      _capHz += _ceilingHz / 10;
+      if (_capHz > _ceilingHz) _capHz = _ceilingHz;
+    }
+
+    uint32_t target = _floorHz + (uint32_t)(_energy * (_ceilingHz - _floorHz));
+    if (target > _capHz) target = _capHz;
+    target = target / ADAPTIVE_RATE_STEP_HZ * ADAPTIVE_RATE_STEP_HZ;
+    if (target < _floorHz) target = _floorHz;
+    _rateHz = target;
+    return _rateHz;
+  }
+
+  uint32_t rate() const { return _rateHz; }
+  uint32_t capHz() const { return _capHz; }
+  float energy() const { return _energy; }
+  bool congested() const { return _congested; }
+
+private:
+  uint32_t _floorHz;
+  uint32_t _ceilingHz;
+  uint32_t _capHz;
+  uint32_t _rateHz;
+  float _energy;
+  float _peak;
+  uint32_t _lastPackets;
+  uint32_t _lastFailures;
+  bool _congested;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * Raw MPU6050 counts and their conversion to the int16 milli-units sent over OSC.
+ *
+ * The sampling task only stores counts; the network task scales them with the
+ * per-range factors MpuRaw::readScales() found (SI units per count), so the
+ * float work stays off the acquisition path.
+ */
+#ifndef MILLI_UNITS_H
+#define MILLI_UNITS_H
+
+#include <stdint.h>
+
+// Raw sensor counts; mpuRawN.accelScale() / gyroScale() convert them to SI units
+struct ImuSample {
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+};
+
+inline int16_t toMilli(int16_t counts, float scale) {
+  float v = counts * scale;
+  if (v > 32767) return 32767;
+  if (v < -32768) return -32768;
+  return (int16_t)v;
+}
+
+/**
+ * @brief Scales raw counts to the int16 milli-units (m/s^2, rad/s) sent over OSC, saturating at the int16 range.
+ */
+inline ImuSample toMilliUnits(const ImuSample& counts, float accelScale, float gyroScale) {
+  float acc = accelScale * 1000;
+  float gyr = gyroScale * 1000;
+  ImuSample sample = {
+    toMilli(counts.ax, acc), toMilli(counts.ay, acc), toMilli(counts.az, acc),
+    toMilli(counts.gx, gyr), toMilli(counts.gy, gyr), toMilli(counts.gz, gyr)
+  };
+  return sample;
+}
+
+#endif
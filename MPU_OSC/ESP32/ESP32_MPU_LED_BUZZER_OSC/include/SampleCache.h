@@ -0,0 +1,52 @@
+/**
+ * Latest-value cache between the acquisition task and the consumers of a tick.
+ *
+ * The sampling task publishes every reading once; melody, bass and their LEDs
+ * each take a copy of that same reading instead of going to the sensors
+ * themselves. They all see the same data, the bus is read once per sample,
+ * and what plays depends only on what was published, so feeding recorded
+ * samples through publish() replays a performance.
+ *
+ * Copies are made under a spinlock, so a reader never gets half of one
+ * sample and half of the next.
+ */
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <Arduino.h>
+
+template <typename T>
+class SampleCache {
+public:
+  SampleCache() : _value(), _version(0) {}
+
+  /**
+   * @brief Producer side: replaces the cached sample.
+   */
+  void publish(const T& value) {
+    portENTER_CRITICAL(&_mux);
+    _value = value;
+    _version++;
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  /**
+   * @brief Copies out the newest sample.
+   *
+   * @return How many samples were published so far; 0 means out holds no reading yet.
+   */
+  uint32_t take(T& out) const {
+    portENTER_CRITICAL(&_mux);
+    out = _value;
+    uint32_t version = _version;
+    portEXIT_CRITICAL(&_mux);
+    return version;
+  }
+
+private:
+  T _value;
+  uint32_t _version;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
@@ -15,7 +15,17 @@
 #include "pitches.h"
 #include <WiFi.h>
 #include <WiFiUdp.h>
-#include <OSCMessage.h>
+#include "OSCFrame.h"
+#include "OSCDestinations.h"
+#include "OSCTransport.h"
+#include "SampleRing.h"
+#include "FixedRateSampler.h"
+#include "AdaptiveRate.h"
+#include "MpuRaw.h"
+#include "MpuFifo.h"
+#include "MpuCalibration.h"
+#include "SampleCache.h"
+#include "MilliUnits.h"
 
 // ESP32 pin GPIO18 connected to piezo buzzer
 #define BUZZZER_PIN_1  25
@@ -27,6 +37,20 @@
 #define LED_PIN_MELODY 27 //D27
 #define LED_LEN_MELODY 44
 
+#define I2C_CLOCK_HZ 400000 // fast mode: both MPUs are read back-to-back in one acquisition slot
+#define SAMPLE_RATE_HZ 100 // boot OSC sampling rate, 50..1000 Hz (Serial "r<hz>" changes it)
+//#define ADAPTIVE_RATE // follow motion energy and link quality between the floor and ceiling rates
+#define ADAPTIVE_RATE_FLOOR_HZ 50
+#define ADAPTIVE_RATE_CEILING_HZ 200
+#define ADAPTIVE_RATE_WINDOW_MS 250 // how often the rate is reconsidered and reported on /rate
+//#define MPU_FIFO // queue samples in both MPU6050 FIFOs and drain them in bursts instead of reading on every tick
+#define MPU_FIFO_DRAIN_MS 20 // how often the FIFOs are drained; each holds 85 samples
+#define MPU_FIFO_MAX_SKEW 4 // frames one sensor may run ahead of the other before its extra frames are dropped
+#define SAMPLE_RING_DEPTH 32 // samples buffered between the sampling and network tasks (power of two)
+//#define OSC_IMU_BLOB // send /imu1 /imu2 packed int16 blobs instead of float /acc /gyr messages
+#define NETWORK_TASK_CORE 0 // WiFi stack core
+#define SAMPLING_TASK_CORE 1 // same core as loop(), at a higher priority
+
 struct note
 {
   int pitch;
@@ -51,9 +75,20 @@ unsigned long previousMillisMelody = 0, previousMillisBass = 0;
 struct note melodyCurrentNote = {0, 3, 0, false};
 struct note bassCurrentNote = {0, 0, 0, false};
 
-// MPU6050 sensor objects
+// MPU6050 sensor objects; the Adafruit driver configures them
 Adafruit_MPU6050 mpu1;
 Adafruit_MPU6050 mpu2;
+// Raw-count access to the same two chips, for sampling and their scale factors
+MpuRaw mpuRaw1(0x68);
+MpuRaw mpuRaw2(0x69);
+// Zero offsets in each sensor's own registers, kept in NVS
+MpuCalibration calibration1(mpuRaw1);
+MpuCalibration calibration2(mpuRaw2);
+volatile bool calibrationRequested = false; // run by the sampling task, which owns the bus
+#ifdef MPU_FIFO
+MpuFifo fifo1(mpuRaw1);
+MpuFifo fifo2(mpuRaw2);
+#endif
 
 // LED strip objects
 Adafruit_NeoPixel NeoPixel_B(LED_LEN_BASS, LED_PIN_BASS, NEO_GRB + NEO_KHZ800);
@@ -61,19 +96,87 @@ Adafruit_NeoPixel NeoPixel_M(LED_LEN_MELODY, LED_PIN_MELODY, NEO_GRB + NEO_KHZ80
 int pixelMelody = 0, pixelBass = 0;
 
 // WiFi credentials
-WiFiUDP Udp1, Udp2; // Multiple UDP instances
+WiFiUDP Udp; // single socket shared by every destination
 const char* ssid = "CUCA_BELUDO";
 const char* password = "cuca_areka";
 
 // OSC server addresses and ports
 String oscServerIp = "192.168.0.10";
+IPAddress oscServerAddress; // oscServerIp resolved once, at boot
 const int oscServerPort1 = 8000;
 const int oscServerPort2 = 8001;
+// Every packet is encoded once and fanned out to all of these (editable over Serial)
+OSCDestinations destinations;
+// Multicast/broadcast output: one datagram reaches every listener on the LAN
+IPAddress oscMulticastGroup(239, 0, 0, 57);
+const int oscMulticastPort = 8000;
+const OSCOutputMode oscOutputMode = OSC_OUTPUT_UNICAST; // mode used at boot
+OSCOutputMode outputMode = oscOutputMode;
+// Every encoded packet leaves through one transport; setOutputMode() picks it
+UdpTransport udpTransport(Udp, destinations);
+UdpMulticastTransport multicastTransport(Udp, destinations);
+OSCTransport* volatile transport = &udpTransport;
+
+// One reading of both sensors, as sent on /acc1 /gyr1 /acc2 /gyr2
+struct DualImuSample {
+  int64_t timestampUs; // esp_timer time of the read
+  uint32_t seq;        // sample number, counted by the sampling task
+  ImuSample mpu1;
+  ImuSample mpu2;
+};
 
-OSCMessage gyr1("/gyr1");
-OSCMessage acc1("/acc1");
-OSCMessage gyr2("/gyr2");
-OSCMessage acc2("/acc2");
+// The sampling task produces samples, the network task encodes and sends them
+SampleRing<DualImuSample, SAMPLE_RING_DEPTH> sampleRing;
+// The newest acquisition: melody, bass and their LEDs all play from it
+SampleCache<DualImuSample> sampleCache;
+FixedRateSampler sampler;
+volatile uint32_t requestedRateHz = SAMPLE_RATE_HZ;
+TaskHandle_t networkTaskHandle = NULL;
+volatile uint32_t samplesSent = 0;
+#ifdef ADAPTIVE_RATE
+AdaptiveRate adaptiveRate(ADAPTIVE_RATE_FLOOR_HZ, ADAPTIVE_RATE_CEILING_HZ);
+volatile bool adaptiveRateEnabled = true; // cleared by a manual "r<hz>"
+int lastRssi = 0;
+#endif
+uint32_t packetSeq = 0; // per-datagram sequence number, owned by the network task
+
+// Preencoded OSC packets, one per address; only the value slots change per sample.
+// /accN and /gyrN carry x, y, z, the packet sequence number and the device timestamp (us).
+OSCFrame gyr1, acc1, gyr2, acc2;
+#ifdef ADAPTIVE_RATE
+OSCFrame rateMsg; // /rate ,iif: sample rate (Hz), RSSI (dBm), motion energy (0..1)
+#endif
+#ifdef OSC_IMU_BLOB
+// /imuN ,hib: timestamp (us), packet seq, blob of uint32 seq, uint16 count, uint16 interval_us, then count x int16 ax..gz
+// in milli-units (mm/s^2, mrad/s, as /accN and /gyrN), all little-endian
+#define IMU_BLOB_HEADER 8
+#define IMU_BLOB_SAMPLE 12
+OSCFrame imu1, imu2;
+#endif
+
+/**
+ * Builds the fixed layout (address, type tags, padding) of every sensor packet.
+ */
+void setupOSCFrames(){
+#ifdef OSC_IMU_BLOB
+  imu1.begin();
+  imu1.addMessage("/imu1", "hib", IMU_BLOB_HEADER + IMU_BLOB_SAMPLE);
+  imu2.begin();
+  imu2.addMessage("/imu2", "hib", IMU_BLOB_HEADER + IMU_BLOB_SAMPLE);
+#endif
+  acc1.begin();
+  acc1.addMessage("/acc1", "fffih");
+  gyr1.begin();
+  gyr1.addMessage("/gyr1", "fffih");
+  acc2.begin();
+  acc2.addMessage("/acc2", "fffih");
+  gyr2.begin();
+  gyr2.addMessage("/gyr2", "fffih");
+#ifdef ADAPTIVE_RATE
+  rateMsg.begin();
+  rateMsg.addMessage("/rate", "iif");
+#endif
+}
 
 
 /**
@@ -361,9 +464,19 @@ void defineColorBass(float octave, float pitch, float duration){
   }
 }
 
-void playBassNote(sensors_event_t a2, sensors_event_t g2){
-  float totalAcc2 = sqrt(a2.acceleration.x * a2.acceleration.x + a2.acceleration.y * a2.acceleration.y);
-  float totalSpin2 = sqrt(g2.gyro.x * g2.gyro.x + g2.gyro.y * g2.gyro.y);
+/**
+ * @brief Motion of one sensor as the notes use it: acceleration (m/s^2) and spin (rad/s) over the x/y axes.
+ */
+void sampleMotion(const ImuSample& sample, const MpuRaw& mpu, float& totalAcc, float& totalSpin){
+  float ax = sample.ax, ay = sample.ay;
+  float gx = sample.gx, gy = sample.gy;
+  totalAcc = sqrtf(ax * ax + ay * ay) * mpu.accelScale();
+  totalSpin = sqrtf(gx * gx + gy * gy) * mpu.gyroScale();
+}
+
+void playBassNote(const ImuSample& sample2){
+  float totalAcc2, totalSpin2;
+  sampleMotion(sample2, mpuRaw2, totalAcc2, totalSpin2);
 
   defineBassNote(totalAcc2, totalSpin2);
   tone(BUZZZER_PIN_2, bb_scale[bassCurrentNote.octave][bassCurrentNote.pitch]);
@@ -371,9 +484,9 @@ void playBassNote(sensors_event_t a2, sensors_event_t g2){
   playBassLEDs();
 }
 
-void playMelodyNote(sensors_event_t a1, sensors_event_t g1){
-  float totalAcc1 = sqrt(a1.acceleration.x * a1.acceleration.x + a1.acceleration.y * a1.acceleration.y);
-  float totalSpin1 = sqrt(g1.gyro.x * g1.gyro.x + g1.gyro.y * g1.gyro.y);
+void playMelodyNote(const ImuSample& sample1){
+  float totalAcc1, totalSpin1;
+  sampleMotion(sample1, mpuRaw1, totalAcc1, totalSpin1);
 
   defineMelodyNote(totalAcc1, totalSpin1);
   tone(BUZZZER_PIN_1, bb_scale[melodyCurrentNote.octave][melodyCurrentNote.pitch]);
@@ -446,46 +559,466 @@ void printMPUData(sensors_event_t a, sensors_event_t g, sensors_event_t temp){
 }
 
 void sendOSCMessages(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz, 
-  OSCMessage& accMsg, OSCMessage& gyrMsg) {
+  int64_t timestampUs, OSCFrame& accMsg, OSCFrame& gyrMsg) {
   // Publish accelerometer data
-  accMsg.add((float)ax);
-  accMsg.add((float)ay);
-  accMsg.add((float)az);
+  accMsg.setFloat(0, ax);
+  accMsg.setFloat(1, ay);
+  accMsg.setFloat(2, az);
+  accMsg.setInt(3, ++packetSeq);
+  accMsg.setInt64(4, timestampUs);
 
   // Publish gyroscope data
-  gyrMsg.add((float)gx);
-  gyrMsg.add((float)gy);
-  gyrMsg.add((float)gz);
-
-  // Send to first port
-  Udp1.beginPacket(oscServerIp.c_str(), oscServerPort1);
-  accMsg.send(Udp1);
-  Udp1.endPacket();
-  accMsg.empty();
-
-  Udp1.beginPacket(oscServerIp.c_str(), oscServerPort1);
-  gyrMsg.send(Udp1);
-  Udp1.endPacket();
-  gyrMsg.empty();
-
-  // Send to second port
-  Udp2.beginPacket(oscServerIp.c_str(), oscServerPort2);
-  accMsg.send(Udp2);
-  Udp2.endPacket();
-  accMsg.empty();
-
-  Udp2.beginPacket(oscServerIp.c_str(), oscServerPort2);
-  gyrMsg.send(Udp2);
-  Udp2.endPacket();
-  gyrMsg.empty();
+  gyrMsg.setFloat(0, gx);
+  gyrMsg.setFloat(1, gy);
+  gyrMsg.setFloat(2, gz);
+  gyrMsg.setInt(3, ++packetSeq);
+  gyrMsg.setInt64(4, timestampUs);
+
+  // Each message is encoded once and sent to every destination
+  transport->send(accMsg.data(), accMsg.size());
+  transport->send(gyrMsg.data(), gyrMsg.size());
+}
+
+#ifdef OSC_IMU_BLOB
+static void putLE16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+/**
+ * @brief Sends one sensor reading as int16 milli-units (see toMilliUnits()): 12 bytes of payload instead of two float messages.
+ */
+void sendOSCImu(const ImuSample& sample, int64_t timestampUs, uint32_t seq, OSCFrame& imuMsg) {
+  imuMsg.setInt64(0, timestampUs);
+  imuMsg.setInt(1, ++packetSeq);
+  uint8_t* p = imuMsg.blob(2);
+  putLE16(p, (uint16_t)seq);
+  putLE16(p + 2, (uint16_t)(seq >> 16));
+  putLE16(p + 4, 1);
+  putLE16(p + 6, (uint16_t)sampler.periodUs());
+  p += IMU_BLOB_HEADER;
+  putLE16(p + 0, sample.ax);
+  putLE16(p + 2, sample.ay);
+  putLE16(p + 4, sample.az);
+  putLE16(p + 6, sample.gx);
+  putLE16(p + 8, sample.gy);
+  putLE16(p + 10, sample.gz);
+  transport->send(imuMsg.data(), imuMsg.size());
+}
+#endif
+
+/**
+ * @brief Switches between the unicast destination table and a single multicast/broadcast send.
+ */
+void setOutputMode(OSCOutputMode mode) {
+  if (mode == OSC_OUTPUT_MULTICAST) {
+    multicastTransport.setGroup(oscMulticastGroup, oscMulticastPort);
+    transport = &multicastTransport;
+  } else if (mode == OSC_OUTPUT_BROADCAST) {
+    multicastTransport.setGroup(WiFi.broadcastIP(), oscMulticastPort, true);
+    transport = &multicastTransport;
+  } else {
+    transport = &udpTransport;
+  }
+  outputMode = mode;
+}
+
+void printDestinations(){
+  if (outputMode != OSC_OUTPUT_UNICAST) {
+    Serial.print(multicastTransport.name());
+    Serial.print(" ");
+    Serial.print(multicastTransport.group());
+    Serial.print(":");
+    Serial.println(multicastTransport.port());
+    return;
+  }
+  for (int i = 0; i < destinations.count(); i++) {
+    Serial.print(i);
+    Serial.print(": ");
+    Serial.print(destinations[i].ip);
+    Serial.print(":");
+    Serial.println(destinations[i].port);
+  }
+}
+
+void printSendStats(){
+  const OSCSendStats& stats = destinations.stats();
+  Serial.print("samples produced: ");
+  Serial.print(sampleRing.produced());
+  Serial.print(", sent: ");
+  Serial.print(samplesSent);
+  Serial.print(", dropped: ");
+  Serial.print(sampleRing.dropped());
+  Serial.print(", ring: ");
+  Serial.print(sampleRing.size());
+  Serial.print("/");
+  Serial.println(sampleRing.capacity());
+  SamplerJitterStats jitter = sampler.stats();
+  Serial.print("rate Hz: ");
+  Serial.print(sampler.rate());
+  Serial.print(", mean interval us: ");
+  Serial.print(jitter.meanIntervalUs);
+  Serial.print(", stddev us: ");
+  Serial.print(jitter.stddevUs);
+  Serial.print(", max deviation us: ");
+  Serial.print(jitter.maxDeviationUs);
+  Serial.print(", missed ticks: ");
+  Serial.println(jitter.missedTicks);
+#ifdef MPU_FIFO
+  Serial.print("fifo frames: ");
+  Serial.print(fifo1.frames());
+  Serial.print("/");
+  Serial.print(fifo2.frames());
+  Serial.print(", overflows: ");
+  Serial.print(fifo1.overflows());
+  Serial.print("/");
+  Serial.print(fifo2.overflows());
+  Serial.print(", i2c errors: ");
+  Serial.println(mpuRaw1.errors() + mpuRaw2.errors());
+#endif
+  Serial.print("calibration: ");
+  Serial.print(calibration1.statusText());
+  Serial.print("/");
+  Serial.println(calibration2.statusText());
+#ifdef ADAPTIVE_RATE
+  Serial.print("adaptive: ");
+  Serial.print(adaptiveRateEnabled ? "on" : "off");
+  Serial.print(", energy: ");
+  Serial.print(adaptiveRate.energy());
+  Serial.print(", link cap Hz: ");
+  Serial.print(adaptiveRate.capHz());
+  Serial.print(adaptiveRate.congested() ? " (congested)" : "");
+  Serial.print(", RSSI dBm: ");
+  Serial.println(lastRssi);
+#endif
+  Serial.print("packets: ");
+  Serial.print(stats.packets);
+  Serial.print(", failures: ");
+  Serial.print(stats.failures);
+  Serial.print(", avg send us: ");
+  Serial.print(stats.averageMicros());
+  Serial.print(", max send us: ");
+  Serial.println(stats.maxMicros);
+}
+
+#define SERIAL_COMMAND_MAX 40 // "+<hostname>:<port>" and the like
+
+/**
+ * @brief Runs one Serial command line, see handleSerialCommands().
+ */
+void runSerialCommand(String command){
+  command.trim();
+  if (command.startsWith("+")) {
+    int colon = command.indexOf(':');
+    int port = colon > 0 ? command.substring(colon + 1).toInt() : 0;
+    IPAddress ip;
+    if (port <= 0 || port > 65535 || !OSCDestinations::resolve(command.substring(1, colon), ip) ||
+        !destinations.add(ip, port)) {
+      Serial.println("Could not add destination, use +<ip>:<port>");
+    }
+  } else if (command.startsWith("m")) {
+    IPAddress group;
+    if (command.length() > 1 && (!group.fromString(command.substring(1)) || group[0] < 224 || group[0] > 239)) {
+      Serial.println("Invalid multicast group");
+      return;
+    }
+    if (command.length() > 1) oscMulticastGroup = group;
+    setOutputMode(OSC_OUTPUT_MULTICAST);
+  } else if (command.startsWith("r")) {
+    int rate = command.substring(1).toInt();
+    if (rate < SAMPLER_MIN_RATE_HZ || rate > SAMPLER_MAX_RATE_HZ) {
+      Serial.println("Sample rate must be 50..1000 Hz");
+    } else {
+      requestedRateHz = rate; // applied by the sampling task on its next tick
+#ifdef ADAPTIVE_RATE
+      adaptiveRateEnabled = false;
+#endif
+    }
+    return;
+#ifdef ADAPTIVE_RATE
+  } else if (command == "a") {
+    adaptiveRateEnabled = true;
+    Serial.println("Adaptive rate on");
+    return;
+#endif
+  } else if (command == "c") {
+    calibrationRequested = true; // done by the sampling task, about 2 s per MPU without samples
+    return;
+  } else if (command == "s") {
+    printSendStats();
+    destinations.resetStats();
+    return;
+  } else if (command == "b") {
+    setOutputMode(OSC_OUTPUT_BROADCAST);
+  } else if (command == "u") {
+    setOutputMode(OSC_OUTPUT_UNICAST);
+  } else if (command.startsWith("-")) {
+    if (!destinations.remove(command.substring(1).toInt())) {
+      Serial.println("No such destination");
+    }
+  }
+  printDestinations();
+}
+
+/**
+ * @brief Edits the OSC destination table from Serial commands.
+ *
+ * - "+<ip>:<port>" adds a destination
+ * - "-<index>" removes a destination
+ * - "m[<group>]" switches to multicast, optionally to a new group
+ * - "b" switches to broadcast, "u" back to the unicast destination list
+ * - "?" lists the destinations
+ * - "s" prints and resets the send timing counters
+ * - "r<hz>" sets the OSC sampling rate (50..1000 Hz) and turns the adaptive rate off
+ * - "a" turns the adaptive rate back on
+ * - "c" recalibrates both MPUs (lay them flat and still) and stores the offsets
+ *
+ * Only takes the bytes already received, so loop() never waits on the port:
+ * "c", "s", "b", "u", "a" and "?" act as soon as they arrive at the start of
+ * a line, the others once their line ends.
+ */
+void handleSerialCommands(){
+  static char line[SERIAL_COMMAND_MAX + 1];
+  static uint8_t length = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      line[length] = '\0';
+      if (length > 0) runSerialCommand(String(line));
+      length = 0;
+    } else if (length == 0 && c != '\0' && strchr("csbua?", c)) {
+      char command[2] = {c, '\0'};
+      runSerialCommand(String(command));
+    } else if (length < SERIAL_COMMAND_MAX) {
+      line[length++] = c;
+    }
+  }
+}
+
+#ifdef ADAPTIVE_RATE
+/**
+ * @brief Feeds a sample's motion to the rate controller, measured like playMelodyNote() does.
+ */
+void addMotion(const ImuSample& sample, const MpuRaw& mpu) {
+  float totalAcc, totalSpin;
+  sampleMotion(sample, mpu, totalAcc, totalSpin);
+  adaptiveRate.addMotion(totalAcc, totalSpin);
+}
+
+/**
+ * @brief Picks the next sample rate from the last window's motion and send results, and reports it on /rate.
+ */
+void updateAdaptiveRate() {
+  const OSCSendStats& stats = destinations.stats();
+  lastRssi = WiFi.RSSI();
+  uint32_t rate = adaptiveRate.update(stats.packets, stats.failures, lastRssi);
+  if (adaptiveRateEnabled) requestedRateHz = rate; // applied by the sampling task on its next tick
+
+  rateMsg.setInt(0, requestedRateHz);
+  rateMsg.setInt(1, lastRssi);
+  rateMsg.setFloat(2, adaptiveRate.energy());
+  transport->send(rateMsg.data(), rateMsg.size());
+}
+#endif
+
+/**
+ * @brief Drains the sample ring and sends each sample, pinned to the WiFi core.
+ *
+ * Runs apart from loop() so a stalled endPacket() no longer holds up the
+ * tones and LEDs; if the ring fills up the oldest samples are dropped.
+ */
+void networkTask(void* parameter) {
+  DualImuSample sample;
+#ifdef ADAPTIVE_RATE
+  unsigned long lastRateUpdate = millis();
+#endif
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+#ifdef ADAPTIVE_RATE
+    if (millis() - lastRateUpdate >= ADAPTIVE_RATE_WINDOW_MS) {
+      lastRateUpdate = millis();
+      updateAdaptiveRate();
+    }
+#endif
+    while (sampleRing.pop(sample)) {
+#ifdef ADAPTIVE_RATE
+      addMotion(sample.mpu1, mpuRaw1);
+      addMotion(sample.mpu2, mpuRaw2);
+#endif
+      // The wire format stays in milli-units; counts are converted here, off the sampling task
+      ImuSample milli1 = toMilliUnits(sample.mpu1, mpuRaw1.accelScale(), mpuRaw1.gyroScale());
+      ImuSample milli2 = toMilliUnits(sample.mpu2, mpuRaw2.accelScale(), mpuRaw2.gyroScale());
+#ifdef OSC_IMU_BLOB
+      sendOSCImu(milli1, sample.timestampUs, sample.seq, imu1);
+      sendOSCImu(milli2, sample.timestampUs, sample.seq, imu2);
+#else
+      sendOSCMessages(milli1.ax, milli1.ay, milli1.az,
+                      milli1.gx, milli1.gy, milli1.gz, sample.timestampUs, acc1, gyr1);
+      sendOSCMessages(milli2.ax, milli2.ay, milli2.az,
+                      milli2.gx, milli2.gy, milli2.gz, sample.timestampUs, acc2, gyr2);
+#endif
+      samplesSent++;
+    }
+  }
 }
 
+ImuSample toImuSample(const MpuRawSample& raw){
+  ImuSample sample = {raw.ax, raw.ay, raw.az, raw.gx, raw.gy, raw.gz};
+  return sample;
+}
+
+/**
+ * @brief Measures and stores new zero offsets for both MPUs; they must lie flat and still.
+ */
+void calibrateMpus() {
+  Serial.println("Calibrating MPU6050s, keep them flat and still");
+  calibration1.calibrate();
+  calibration2.calibrate();
+  Serial.print("MPU6050 calibration: ");
+  Serial.print(calibration1.statusText());
+  Serial.print("/");
+  Serial.println(calibration2.statusText());
+}
+
+#ifdef MPU_FIFO
+
+/**
+ * @brief Programs both sample-rate dividers: rate = 1 kHz / (1 + divider) with the DLPF on.
+ *
+ * @return The rate the sensors actually run at.
+ */
+uint32_t setMpuRate(uint32_t rateHz) {
+  if (rateHz < SAMPLER_MIN_RATE_HZ) rateHz = SAMPLER_MIN_RATE_HZ;
+  if (rateHz > SAMPLER_MAX_RATE_HZ) rateHz = SAMPLER_MAX_RATE_HZ;
+  uint8_t divider = (1000 + rateHz / 2) / rateHz - 1;
+  mpu1.setSampleRateDivisor(divider);
+  mpu2.setSampleRateDivisor(divider);
+  return 1000 / (divider + 1);
+}
+
+/**
+ * @brief Drains both MPU FIFOs every MPU_FIFO_DRAIN_MS and queues the paired samples for OSC.
+ *
+ * Frames are paired by position: the n-th frame of mpu1 with the n-th of
+ * mpu2. The two chips run off their own oscillators, so one slowly gets
+ * ahead; past MPU_FIFO_MAX_SKEW frames its oldest extra frames are dropped.
+ * An overflow in either restarts both, keeping the pairs lined up, and the
+ * lost samples are skipped in seq.
+ */
+void samplingTask(void* parameter) {
+  static MpuRawSample frames1[MPU_FIFO_MAX_FRAMES];
+  static MpuRawSample frames2[MPU_FIFO_MAX_FRAMES];
+  uint32_t appliedRateHz = requestedRateHz;
+  sampler.setRate(setMpuRate(appliedRateHz)); // no timer, only records the rate
+  fifo1.begin();
+  fifo2.begin();
+  DualImuSample sample;
+  sample.seq = 0;
+  int64_t lastDrainUs = esp_timer_get_time();
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(MPU_FIFO_DRAIN_MS));
+    int n1 = fifo1.available();
+    int n2 = fifo2.available();
+    int64_t now = esp_timer_get_time();
+    uint32_t periodUs = sampler.periodUs();
+    if (n1 < 0 || n2 < 0) {
+      fifo1.reset();
+      fifo2.reset();
+      sample.seq += (uint32_t)((now - lastDrainUs) / periodUs);
+      n1 = n2 = 0;
+    } else if (n1 > n2 + MPU_FIFO_MAX_SKEW) {
+      n1 -= fifo1.read(NULL, n1 - n2);
+    } else if (n2 > n1 + MPU_FIFO_MAX_SKEW) {
+      n2 -= fifo2.read(NULL, n2 - n1);
+    }
+    lastDrainUs = now;
+    int n = n1 < n2 ? n1 : n2;
+    if (n > 0) {
+      int read1 = fifo1.read(frames1, n);
+      int read2 = fifo2.read(frames2, n);
+      n = read1 < read2 ? read1 : read2;
+    }
+    for (int i = 0; i < n; i++) {
+      sample.timestampUs = now - (int64_t)(n - 1 - i) * periodUs;
+      sample.seq++;
+      sample.mpu1 = toImuSample(frames1[i]);
+      sample.mpu2 = toImuSample(frames2[i]);
+      sampleRing.push(sample);
+    }
+    if (n > 0) {
+      sampleCache.publish(sample);
+      xTaskNotifyGive(networkTaskHandle);
+    }
+
+    // Changed right after a drain and without a FIFO reset, so nothing queued is lost;
+    // at most one frame still at the old rate gets stamped with the new period
+    if (requestedRateHz != appliedRateHz) {
+      appliedRateHz = requestedRateHz;
+      sampler.setRate(setMpuRate(appliedRateHz));
+    }
+    if (calibrationRequested) {
+      calibrationRequested = false;
+      calibrateMpus();
+      // What queued up meanwhile overflowed anyway; count it as lost like an overflow
+      fifo1.reset();
+      fifo2.reset();
+      int64_t now = esp_timer_get_time();
+      sample.seq += (uint32_t)((now - lastDrainUs) / sampler.periodUs());
+      lastDrainUs = now;
+    }
+  }
+}
+#else
+/**
+ * @brief Reads both MPUs once per sampler tick and queues the timestamped sample for OSC.
+ *
+ * This task is the only one on the I2C bus: mpu1 and mpu2 are read
+ * back-to-back in one slot and share one timestamp; the same reading goes to
+ * the OSC ring and to sampleCache, which loop() plays from. Each read is one
+ * 14-byte burst kept in counts: no temperature, no float conversion here.
+ */
+void samplingTask(void* parameter) {
+  sampler.begin(requestedRateHz);
+  DualImuSample sample;
+  sample.seq = 0;
+  MpuRawSample raw1, raw2;
+  for (;;) {
+    if (requestedRateHz != sampler.rate()) sampler.setRate(requestedRateHz);
+    if (calibrationRequested) {
+      calibrationRequested = false;
+      calibrateMpus();
+    }
+    sample.timestampUs = sampler.wait();
+    sample.seq++;
+    // A failed read is skipped (the seq gap shows it)
+    if (!mpuRaw1.read(raw1) || !mpuRaw2.read(raw2)) continue;
+    sample.mpu1 = toImuSample(raw1);
+    sample.mpu2 = toImuSample(raw2);
+
+    // Hand the sample to the network task; never blocks on WiFi
+    sampleRing.push(sample);
+    sampleCache.publish(sample);
+    xTaskNotifyGive(networkTaskHandle);
+  }
+}
+#endif
+
 void setup() {
   Serial.begin(115200);
   while (!Serial)
     delay(10);
 
   setMPUConfigurations();
+  Wire.setClock(I2C_CLOCK_HZ);
+  // Scale factors for the ranges setMPUConfigurations() picked
+  mpuRaw1.readScales();
+  mpuRaw2.readScales();
+  // Stored offsets go straight back into the sensors; measuring new ones is left to "c" or /calibrate
+  bool loaded1 = calibration1.load();
+  bool loaded2 = calibration2.load();
+  if (loaded1 && loaded2) Serial.println("MPU6050 calibration loaded");
+  else Serial.println("MPU6050 not calibrated, send \"c\" with both flat and still");
+  setupOSCFrames();
   NeoPixel_B.begin();
   NeoPixel_M.begin();
 
@@ -498,13 +1031,25 @@ void setup() {
   Serial.println("WiFi connected");
   Serial.print("ESP32 IP address: ");
   Serial.println(WiFi.localIP());
+  if (!OSCDestinations::resolve(oscServerIp, oscServerAddress)) {
+    Serial.println("Could not resolve OSC server " + oscServerIp);
+  }
+  destinations.add(oscServerAddress, oscServerPort1);
+  destinations.add(oscServerAddress, oscServerPort2);
+  setOutputMode(oscOutputMode);
+  xTaskCreatePinnedToCore(networkTask, "osc_tx", 4096, NULL, 2, &networkTaskHandle, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(samplingTask, "sampler", 4096, NULL, 3, NULL, SAMPLING_TASK_CORE);
 
   delay(100);
 }
 
 unsigned long currentMillis = millis();
 void loop() {
+  handleSerialCommands();
   currentMillis = millis();
+  // One coherent reading of both sensors for this pass; the sampling task owns the bus
+  DualImuSample snapshot;
+  sampleCache.take(snapshot);
   if (currentMillis - previousMillisMelody >= melodyCurrentNote.duration) {
     Serial.println("mel");
     previousMillisMelody = currentMillis;
@@ -514,10 +1059,7 @@ void loop() {
       noTone(BUZZZER_PIN_1);
       melodyCurrentNote.is_playing = false;
     }
-    sensors_event_t a1, g1, temp1;
-    mpu1.getEvent(&a1, &g1, &temp1);
-    //printMPUData(a1, g1, temp1);
-    playMelodyNote(a1, g1);
+    playMelodyNote(snapshot.mpu1);
   }
 
   if (currentMillis - previousMillisBass >= bassCurrentNote.duration) {
@@ -529,21 +1071,9 @@ void loop() {
       noTone(BUZZZER_PIN_2);
       bassCurrentNote.is_playing = false;
     }
-    sensors_event_t a2, g2, temp2;
-    mpu2.getEvent(&a2, &g2, &temp2);
-    //printMPUData(a2, g2, temp2);
-    playBassNote(a2, g2);
+    playBassNote(snapshot.mpu2);
   }
 
-  sensors_event_t a1, g1, temp1;
-  mpu1.getEvent(&a1, &g1, &temp1);
-  sendOSCMessages((int16_t)(a1.acceleration.x * 1000), (int16_t)(a1.acceleration.y * 1000), (int16_t)(a1.acceleration.z * 1000),
-                  (int16_t)(g1.gyro.x * 1000), (int16_t)(g1.gyro.y * 1000), (int16_t)(g1.gyro.z * 1000), acc1, gyr1);
-
-  sensors_event_t a2, g2, temp2;
-  mpu2.getEvent(&a2, &g2, &temp2);
-  sendOSCMessages((int16_t)(a2.acceleration.x * 1000), (int16_t)(a2.acceleration.y * 1000), (int16_t)(a2.acceleration.z * 1000),
-                  (int16_t)(g2.gyro.x * 1000), (int16_t)(g2.gyro.y * 1000), (int16_t)(g2.gyro.z * 1000), acc2, gyr2);
-
+  // OSC sampling runs in its own task; this only paces the note checks
   delay(50);
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+/**
+ * The milli-unit conversion the network task applies to raw counts, at the
+ * scales MpuRaw derives for the firmware's ranges, against the old path
+ * (counts to SI floats as getEvent() does, then scaled back to int16 milli-units).
+ */
+#include <unity.h>
+#include "MilliUnits.h"
+#include "MpuRaw.h"
+
+// The firmware's ranges: MPU6050_RANGE_8_G (AFS_SEL 2) and MPU6050_RANGE_500_DEG (FS_SEL 1)
+static const float accelScale = mpuRawAccelScale(2);
+static const float gyroScale = mpuRawGyroScale(1);
+
+void setUp() {}
+void tearDown() {}
+
+void test_scales_counts_to_milli_units() {
+  ImuSample counts = {4096, -4096, 0, 32767, -32768, 66};
+  ImuSample milli = toMilliUnits(counts, accelScale, gyroScale);
+  TEST_ASSERT_EQUAL_INT16(9806, milli.ax); // 1 g in mm/s^2
+  TEST_ASSERT_EQUAL_INT16(-9806, milli.ay);
+  TEST_ASSERT_EQUAL_INT16(0, milli.az);
+  TEST_ASSERT_EQUAL_INT16(8726, milli.gx); // 500 deg/s in mrad/s
+  TEST_ASSERT_EQUAL_INT16(-8726, milli.gy);
+  TEST_ASSERT_EQUAL_INT16(17, milli.gz);
+}
+
+void test_saturates_at_the_int16_range() {
+  // +-8 g full scale is 78453 mm/s^2, beyond int16 from about 3.34 g (13686 counts)
+  ImuSample counts = {32767, -32768, 13000, 0, 0, 0};
+  ImuSample milli = toMilliUnits(counts, accelScale, gyroScale);
+  TEST_ASSERT_EQUAL_INT16(32767, milli.ax);
+  TEST_ASSERT_EQUAL_INT16(-32768, milli.ay);
+  TEST_ASSERT_EQUAL_INT16(31124, milli.az);
+}
+
+void test_matches_the_si_path() {
+  // Only where the old path did not overflow int16 (about +-3.34 g)
+  for (int v = -13600; v <= 13600; v += 7) {
+    int16_t c = (int16_t)v;
+    ImuSample counts = {c, c, c, c, c, c};
+    ImuSample milli = toMilliUnits(counts, accelScale, gyroScale);
+    // getEvent() floats, then * 1000 as the sampling task used to
+    float acc = c * accelScale, gyr = c * gyroScale;
+    TEST_ASSERT_TRUE(milli.ax - (int16_t)(acc * 1000) <= 1 && (int16_t)(acc * 1000) - milli.ax <= 1);
+    TEST_ASSERT_TRUE(milli.gx - (int16_t)(gyr * 1000) <= 1 && (int16_t)(gyr * 1000) - milli.gx <= 1);
+  }
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_scales_counts_to_milli_units);
+  RUN_TEST(test_saturates_at_the_int16_range);
+  RUN_TEST(test_matches_the_si_path);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  runTests();
+}
+
+void loop() {}
+#else
+int main() {
+  return runTests();
+}
+#endif
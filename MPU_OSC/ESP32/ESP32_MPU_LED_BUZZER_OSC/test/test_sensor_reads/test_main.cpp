@@ -0,0 +1,85 @@
+/**
+ * Per-sample cost of the sensor stage on one MPU6050 (0x68), before and after
+ * the raw-count path: getEvent() + scaling to milli-units, as the sampling task
+ * used to do, against one MpuRaw::read() into counts, as it does now.
+ *
+ * Needs the sensor on the bus, so it runs on the board only:
+ * pio test -e esp32dev -f test_sensor_reads
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <unity.h>
+#include <Adafruit_MPU6050.h>
+#include "MpuRaw.h"
+
+#define I2C_CLOCK_HZ 400000 // as the firmware runs the bus
+#define READ_ITERATIONS 1000
+
+Adafruit_MPU6050 mpu;
+MpuRaw mpuRaw(0x68);
+
+void setUp() {}
+void tearDown() {}
+
+void test_sensor_found() {
+  TEST_ASSERT_TRUE_MESSAGE(mpu.begin(0x68), "no MPU6050 at 0x68");
+  mpu.setAccelerometerRange(MPU6050_RANGE_8_G);
+  mpu.setGyroRange(MPU6050_RANGE_500_DEG);
+  mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
+  Wire.setClock(I2C_CLOCK_HZ);
+  TEST_ASSERT_TRUE(mpuRaw.readScales());
+}
+
+void test_both_paths_read_the_same_gravity() {
+  sensors_event_t a, g, temp;
+  MpuRawSample raw;
+  mpu.getEvent(&a, &g, &temp);
+  TEST_ASSERT_TRUE(mpuRaw.read(raw));
+  float eventNorm = sqrtf(a.acceleration.x * a.acceleration.x + a.acceleration.y * a.acceleration.y +
+                          a.acceleration.z * a.acceleration.z);
+  float rawNorm = sqrtf((float)raw.ax * raw.ax + (float)raw.ay * raw.ay + (float)raw.az * raw.az) *
+                  mpuRaw.accelScale();
+  // Still on the bench: both about 1 g
+  TEST_ASSERT_FLOAT_WITHIN(1.5f, MPU_RAW_STANDARD_GRAVITY, eventNorm);
+  TEST_ASSERT_FLOAT_WITHIN(1.5f, MPU_RAW_STANDARD_GRAVITY, rawNorm);
+}
+
+void test_read_cost() {
+  sensors_event_t a, g, temp;
+  MpuRawSample raw;
+  volatile int16_t sink = 0;
+
+  unsigned long start = micros();
+  for (int i = 0; i < READ_ITERATIONS; i++) {
+    mpu.getEvent(&a, &g, &temp);
+    sink = (int16_t)(a.acceleration.x * 1000) + (int16_t)(g.gyro.x * 1000);
+  }
+  unsigned long eventUs = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < READ_ITERATIONS; i++) {
+    mpuRaw.read(raw);
+    sink = raw.ax + raw.gx;
+  }
+  unsigned long rawUs = micros() - start;
+  (void)sink;
+
+  char line[128];
+  snprintf(line, sizeof(line), "@ %lu Hz I2C: getEvent %lu us/sample, raw counts %lu us/sample (i2c errors %lu)",
+           (unsigned long)I2C_CLOCK_HZ, eventUs / READ_ITERATIONS, rawUs / READ_ITERATIONS,
+           (unsigned long)mpuRaw.errors());
+  TEST_MESSAGE(line);
+  TEST_ASSERT_EQUAL_UINT32(0, mpuRaw.errors());
+}
+
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  Wire.begin();
+  UNITY_BEGIN();
+  RUN_TEST(test_sensor_found);
+  RUN_TEST(test_both_paths_read_the_same_gravity);
+  RUN_TEST(test_read_cost);
+  UNITY_END();
+}
+
+void loop() {}
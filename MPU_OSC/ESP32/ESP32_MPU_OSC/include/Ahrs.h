@@ -0,0 +1,199 @@
+/**
+ * Orientation from the raw accelerometer and gyroscope: a Mahony complementary
+ * filter (IMU form, no magnetometer), updated once per sample.
+ *
+ * The gyroscope rate is integrated into the quaternion; the error between
+ * where it says gravity is and the normalized accelerometer pulls it back,
+ * proportionally to AHRS_TWO_KP. Only the proportional term is kept: the
+ * gyro bias is meant to be calibrated out, and without the integral term the
+ * fixed-point version needs no extra dynamic range.
+ *
+ * Two builds with the same interface:
+ * - MahonyAhrs: float, the reference
+ * - MahonyAhrsQ30: quaternion, half-angle steps and gravity error in Q30
+ *   (int32 with 30 fractional bits), products in int64, one integer division
+ *   and an integer square root per update; the quaternion is renormalized
+ *   with a first-order step, since it never strays far from unit length
+ *
+ * Both take samples in raw counts at a fixed period; begin() folds the gyro
+ * scale and the period into one factor, so an update needs no unit conversion.
+ * Yaw has no absolute reference and drifts with the residual gyro bias.
+ */
+#ifndef AHRS_H
+#define AHRS_H
+
+#include <stdint.h>
+#include <math.h>
+
+#ifndef AHRS_TWO_KP
+#define AHRS_TWO_KP 1.0f // 2 * proportional gain; higher trusts the accelerometer more
+#endif
+
+class MahonyAhrs {
+public:
+  MahonyAhrs() : _gyroFactor(0), _kpFactor(0) { reset(); }
+
+  /**
+   * @brief Sets the gyroscope scale (rad/s per count) and the sample period.
+   */
+  void begin(float gyroScale, uint32_t periodUs) {
+    _gyroScale = gyroScale;
+    setPeriodUs(periodUs);
+  }
+
+  void setPeriodUs(uint32_t periodUs) {
+    float halfDt = periodUs * 0.5e-6f;
+    _gyroFactor = _gyroScale * halfDt;
+    _kpFactor = AHRS_TWO_KP * halfDt;
+  }
+
+  void reset() {
+    _q[0] = 1;
+    _q[1] = _q[2] = _q[3] = 0;
+  }
+
+  /**
+   * @brief Advances the orientation by one sample period (raw counts).
+   */
+  void update(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz) {
+    float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+    // Gyro rate over half a period: the quaternion step
+    float hx = gx * _gyroFactor, hy = gy * _gyroFactor, hz = gz * _gyroFactor;
+
+    float norm = sqrtf((float)ax * ax + (float)ay * ay + (float)az * az);
+    if (norm > 0) {
+      float recip = 1 / norm;
+      float x = ax * recip, y = ay * recip, z = az * recip;
+      // Half the gravity direction the quaternion predicts, crossed with the measured one
+      float vx = q1 * q3 - q0 * q2;
+      float vy = q0 * q1 + q2 * q3;
+      float vz = q0 * q0 - 0.5f + q3 * q3;
+      hx += (y * vz - z * vy) * _kpFactor;
+      hy += (z * vx - x * vz) * _kpFactor;
+      hz += (x * vy - y * vx) * _kpFactor;
+    }
+
+    q0 += -q1 * hx - q2 * hy - q3 * hz;
+    q1 += _q[0] * hx + q2 * hz - q3 * hy;
+    q2 += _q[0] * hy - _q[1] * hz + q3 * hx;
+    q3 += _q[0] * hz + _q[1] * hy - _q[2] * hx;
+    float recip = 1 / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    _q[0] = q0 * recip;
+    _q[1] = q1 * recip;
+    _q[2] = q2 * recip;
+    _q[3] = q3 * recip;
+  }
+
+  // w, x, y, z
+  void getQuaternion(float q[4]) const {
+    for (int i = 0; i < 4; i++) q[i] = _q[i];
+  }
+
+private:
+  float _q[4];
+  float _gyroScale;
+  float _gyroFactor; // rad per count over half a period
+  float _kpFactor;
+};
+
+#define AHRS_Q30_ONE (1L << 30)
+
+class MahonyAhrsQ30 {
+public:
+  MahonyAhrsQ30() : _gyroFactor(0), _kpFactor(0) { reset(); }
+
+  void begin(float gyroScale, uint32_t periodUs) {
+    _gyroScale = gyroScale;
+    setPeriodUs(periodUs);
+  }
+
+  // The only float math: the factors, once per rate change
+  void setPeriodUs(uint32_t periodUs) {
+    double halfDt = periodUs * 0.5e-6;
+    _gyroFactor = (int64_t)(_gyroScale * halfDt * (double)(1LL << 40) + 0.5); // Q40
+    _kpFactor = (int64_t)(AHRS_TWO_KP * halfDt * AHRS_Q30_ONE + 0.5);         // Q30
+  }
+
+  void reset() {
+    _q[0] = AHRS_Q30_ONE;
+    _q[1] = _q[2] = _q[3] = 0;
+  }
+
+  void update(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz) {
+    int32_t q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+    int64_t hx = (gx * _gyroFactor) >> 10;
+    int64_t hy = (gy * _gyroFactor) >> 10;
+    int64_t hz = (gz * _gyroFactor) >> 10;
+
+    uint32_t norm = isqrt((uint32_t)((int32_t)ax * ax) + (uint32_t)((int32_t)ay * ay) + (uint32_t)((int32_t)az * az));
+    if (norm > 0) {
+      // a <= norm, so a * recip stays below 2^46
+      int64_t recip = (1LL << 46) / norm;
+      int32_t x = (int32_t)((ax * recip) >> 16);
+      int32_t y = (int32_t)((ay * recip) >> 16);
+      int32_t z = (int32_t)((az * recip) >> 16);
+      int32_t vx = mul(q1, q3) - mul(q0, q2);
+      int32_t vy = mul(q0, q1) + mul(q2, q3);
+      int32_t vz = mul(q0, q0) - AHRS_Q30_ONE / 2 + mul(q3, q3);
+      hx += ((int64_t)(mul(y, vz) - mul(z, vy)) * _kpFactor) >> 30;
+      hy += ((int64_t)(mul(z, vx) - mul(x, vz)) * _kpFactor) >> 30;
+      hz += ((int64_t)(mul(x, vy) - mul(y, vx)) * _kpFactor) >> 30;
+    }
+
+    q0 += (int32_t)((-q1 * hx - q2 * hy - q3 * hz) >> 30);
+    q1 += (int32_t)((_q[0] * hx + q2 * hz - q3 * hy) >> 30);
+    q2 += (int32_t)((_q[0] * hy - _q[1] * hz + q3 * hx) >> 30);
+    q3 += (int32_t)((_q[0] * hz + _q[1] * hy - _q[2] * hx) >> 30);
+    // 1/sqrt(n) ~ (3 - n) / 2 near n = 1
+    int64_t n = ((int64_t)q0 * q0 + (int64_t)q1 * q1 + (int64_t)q2 * q2 + (int64_t)q3 * q3) >> 30;
+    int32_t recip = (int32_t)((3LL * AHRS_Q30_ONE - n) >> 1);
+    _q[0] = mul(q0, recip);
+    _q[1] = mul(q1, recip);
+    _q[2] = mul(q2, recip);
+    _q[3] = mul(q3, recip);
+  }
+
+  void getQuaternion(float q[4]) const {
+    for (int i = 0; i < 4; i++) q[i] = _q[i] * (1.0f / AHRS_Q30_ONE);
+  }
+
+private:
+  static int32_t mul(int32_t a, int32_t b) { return (int32_t)(((int64_t)a * b) >> 30); }
+
+  static uint32_t isqrt(uint32_t v) {
+    uint32_t root = 0, bit = 1UL << 30;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+      if (v >= root + bit) {
+        v -= root + bit;
+        root = (root >> 1) + bit;
+      } else {
+        root >>= 1;
+      }
+      bit >>= 2;
+    }
+    return root;
+  }
+
+  int32_t _q[4];
+  float _gyroScale;
+  int64_t _gyroFactor; // Q40 rad per count over half a period
+  int64_t _kpFactor;   // Q30
+};
+
+/**
+ * @brief Yaw, pitch, roll (radians) from a quaternion (w, x, y, z), through
+ * the gravity vector, as the MotionApps20 dmpGetYawPitchRoll() computes them.
+ */
+inline void quatToYawPitchRoll(const float q[4], float ypr[3]) {
+  float w = q[0], x = q[1], y = q[2], z = q[3];
+  float gx = 2 * (x * z - w * y);
+  float gy = 2 * (w * x + y * z);
+  float gz = w * w - x * x - y * y + z * z;
+  ypr[0] = atan2f(2 * x * y - 2 * w * z, 2 * w * w + 2 * x * x - 1);
+  ypr[1] = atan2f(gx, sqrtf(gy * gy + gz * gz));
+  ypr[2] = atan2f(gy, gz);
+  if (gz < 0) ypr[1] = (ypr[1] > 0 ? (float)M_PI : -(float)M_PI) - ypr[1];
+}
+
+#endif
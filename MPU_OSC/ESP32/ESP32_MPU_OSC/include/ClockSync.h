@@ -0,0 +1,159 @@
+/**
+ * NTP-style estimate of the receiver's clock, so timetags can be stamped in host time.
+ *
+ * The device sends /sync/ping with its send time t1; the host answers
+ * /sync/pong with t1, its receive time t2 and its send time t3 (Unix epoch,
+ * microseconds), and the device notes the arrival time t4. Each exchange
+ * gives the usual
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2,  rtt = (t4 - t1) - (t3 - t2)
+ *
+ * WiFi delays are long-tailed and asymmetric, so exchanges are grouped in
+ * slots of CLOCK_SYNC_SLOT and only the one with the smallest RTT of each
+ * slot is trusted (its delays are the most symmetric). A least-squares line
+ * through the last CLOCK_SYNC_WINDOW slot minimums gives the current offset
+ * and the drift between the two crystals; with a ping per second that is a
+ * baseline of about two minutes, long enough for a drift in ppm.
+ */
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef CLOCK_SYNC_WINDOW
+#define CLOCK_SYNC_WINDOW 16 // slot minimums kept for the fit
+#endif
+#ifndef CLOCK_SYNC_SLOT
+#define CLOCK_SYNC_SLOT 8 // exchanges per slot
+#endif
+#define CLOCK_SYNC_MIN_SPAN_US 10000000LL // drift is only fitted over at least 10 s
+#define NTP_UNIX_OFFSET 2208988800UL // seconds from 1900 (NTP, OSC timetags) to 1970
+
+// "/sync/pong" ",hhh" t1 t2 t3, all fields big-endian as OSC requires
+#define CLOCK_SYNC_PONG_SIZE 44
+
+class ClockSync {
+public:
+  ClockSync() : _count(0), _next(0), _slotCount(0), _exchanges(0), _rejected(0), _synced(false),
+                _offsetUs(0), _drift(0), _refUs(0), _rttUs(0) {}
+
+  /**
+   * @brief Adds one ping/pong exchange (device times t1, t4; host times t2, t3).
+   *
+   * @return false if the exchange is inconsistent (negative round trip).
+   */
+  bool addExchange(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0 || t3 < t2) {
+      _rejected++;
+      return false;
+    }
+    Exchange e;
+    e.deviceUs = t4;
+    e.offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+    e.rttUs = (uint32_t)rtt;
+    if (_slotCount == 0 || e.rttUs < _slotBest.rttUs) _slotBest = e;
+    _exchanges++;
+    _rttUs = e.rttUs;
+    if (++_slotCount == CLOCK_SYNC_SLOT) {
+      _window[_next] = _slotBest;
+      _next = (_next + 1) % CLOCK_SYNC_WINDOW;
+      if (_count < CLOCK_SYNC_WINDOW) _count++;
+      _slotCount = 0;
+    }
+    refit(t4);
+    return true;
+  }
+
+  /**
+   * @brief Converts a device time (esp_timer microseconds) to host Unix time in microseconds.
+   */
+  int64_t hostUs(int64_t deviceUs) const {
+    return deviceUs + _offsetUs + (int64_t)(_drift * (double)(deviceUs - _refUs));
+  }
+
+  bool synced() const { return _synced; }
+  int64_t offsetUs() const { return _offsetUs; }
+  float driftPpm() const { return (float)(_drift * 1e6); }
+  uint32_t rttUs() const { return _rttUs; }
+  uint32_t exchanges() const { return _exchanges; }
+  uint32_t rejected() const { return _rejected; }
+
+  /**
+   * @brief Reads t1, t2, t3 from a /sync/pong packet.
+   *
+   * @return false if the packet is anything else.
+   */
+  static bool parsePong(const uint8_t* data, size_t size, int64_t& t1, int64_t& t2, int64_t& t3) {
+    static const char header[20] = {'/', 's', 'y', 'n', 'c', '/', 'p', 'o', 'n', 'g', 0, 0,
+                                    ',', 'h', 'h', 'h', 0, 0, 0, 0};
+    if (size != CLOCK_SYNC_PONG_SIZE || memcmp(data, header, sizeof(header)) != 0) return false;
+    t1 = readInt64(data + 20);
+    t2 = readInt64(data + 28);
+    t3 = readInt64(data + 36);
+    return true;
+  }
+
+private:
+  struct Exchange {
+    int64_t deviceUs;
+    int64_t offsetUs;
+    uint32_t rttUs;
+  };
+
+  static int64_t readInt64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return (int64_t)v;
+  }
+
+  // Least-squares offset(deviceUs) through the slot minimums
+  void refit(int64_t refUs) {
+    Exchange points[CLOCK_SYNC_WINDOW + 1];
+    int n = 0;
+    for (int i = 0; i < _count; i++) points[n++] = _window[i];
+    // Until two slots are closed, the open slot's best so far gets things going
+    if (_count < 2 && _slotCount > 0) points[n++] = _slotBest;
+    if (n == 0) return;
+
+    // Relative to the first point, so the sums stay well inside double precision
+    int64_t base = points[0].offsetUs;
+    int64_t first = points[0].deviceUs, last = points[0].deviceUs;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < n; i++) {
+      double x = (double)(points[i].deviceUs - refUs);
+      double y = (double)(points[i].offsetUs - base);
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+      if (points[i].deviceUs < first) first = points[i].deviceUs;
+      if (points[i].deviceUs > last) last = points[i].deviceUs;
+    }
+    double slope = 0;
+    if (n >= 3 && last - first >= CLOCK_SYNC_MIN_SPAN_US) {
+      slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    }
+    double intercept = (sy - slope * sx) / n;
+    _drift = slope;
+    _offsetUs = base + (int64_t)intercept;
+    _refUs = refUs;
+    _synced = true;
+  }
+
+  Exchange _window[CLOCK_SYNC_WINDOW];
+  int _count;
+  int _next;
+  Exchange _slotBest;
+  int _slotCount;
+  uint32_t _exchanges;
+  uint32_t _rejected;
+  bool _synced;
+  int64_t _offsetUs;
+  double _drift; // host seconds gained per device second
+  int64_t _refUs;
+  uint32_t _rttUs;
+};
+
+#endif
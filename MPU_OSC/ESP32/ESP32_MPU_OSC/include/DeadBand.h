@@ -0,0 +1,95 @@
+/**
+ * Change-driven transmit filter for 6-axis samples (ax ay az gx gy gz).
+ *
+ * A sample is worth sending when any axis moved more than its threshold away
+ * from the last value that was actually sent. While the sensor sits still
+ * nothing goes out except a keyframe every heartbeat period, so receivers
+ * that hold the last value keep an exact picture and can tell a quiet
+ * performer from a dead link.
+ */
+#ifndef DEAD_BAND_H
+#define DEAD_BAND_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+class DeadBand {
+public:
+  DeadBand() : _accThreshold(0), _gyrThreshold(0), _heartbeatMs(1000), _hasLast(false),
+               _lastSentUs(0), _skipped(0), _keyframes(0) {}
+
+  /**
+   * @brief Sets the per-axis thresholds in raw sensor counts; 0 only skips exact repeats.
+   */
+  void setThresholds(uint16_t acc, uint16_t gyr) {
+    _accThreshold = acc;
+    _gyrThreshold = gyr;
+  }
+
+  /**
+   * @brief Sets the longest silence before a keyframe is sent anyway.
+   */
+  void setHeartbeatMs(uint32_t ms) { _heartbeatMs = ms; }
+
+  /**
+   * @return true if any axis of v is beyond its threshold from the last sent sample.
+   */
+  bool moved(const int16_t v[6]) const {
+    if (!_hasLast) return true;
+    for (int i = 0; i < 6; i++) {
+      int threshold = i < 3 ? _accThreshold : _gyrThreshold;
+      if (abs((int)v[i] - (int)_last[i]) > threshold) return true;
+    }
+    return false;
+  }
+
+  /**
+   * @return true if nothing was sent for a whole heartbeat period.
+   */
+  bool keyframeDue(int64_t nowUs) const {
+    return !_hasLast || nowUs - _lastSentUs >= (int64_t)_heartbeatMs * 1000;
+  }
+
+  /**
+   * @brief Records v as the value the receivers now hold.
+   */
+  void sent(const int16_t v[6], int64_t nowUs, bool keyframe) {
+    for (int i = 0; i < 6; i++) _last[i] = v[i];
+    _lastSentUs = nowUs;
+    _hasLast = true;
+    if (keyframe) _keyframes++;
+  }
+
+  void skip(uint32_t samples) { _skipped += samples; }
+
+  uint16_t accThreshold() const { return _accThreshold; }
+  uint16_t gyrThreshold() const { return _gyrThreshold; }
+  uint32_t heartbeatMs() const { return _heartbeatMs; }
+  uint32_t skipped() const { return _skipped; }
+  uint32_t keyframes() const { return _keyframes; }
+
+  void resetStats() {
+    _skipped = 0;
+    _keyframes = 0;
+  }
+
+  /**
+   * @brief Forgets the last sent sample, so the next one is always sent.
+   */
+  void reset() {
+    _hasLast = false;
+    resetStats();
+  }
+
+private:
+  volatile uint16_t _accThreshold;
+  volatile uint16_t _gyrThreshold;
+  volatile uint32_t _heartbeatMs;
+  bool _hasLast;
+  int16_t _last[6];
+  int64_t _lastSentUs;
+  uint32_t _skipped;
+  uint32_t _keyframes;
+};
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * The sample wire formats of the OSC firmware, each a preencoded OSCFrame
+ * patched per packet and handed to an OSCTransport:
+ *
+ * - SampleEncoder: one sample as /acc + /gyr ,fffih (x, y, z, packet seq,
+ *   device time in us), in one timetagged bundle or as two messages
+ * - BatchEncoder: /batch ,hii + 6 floats per sample (base time, interval,
+ *   packet seq, then ax ay az gx gy gz of every sample)
+ * - ImuBlobEncoder: /imu ,hib (base time, packet seq, then a blob of uint32
+ *   seq, uint16 count, uint16 interval_us and count x int16 ax..gz, all
+ *   little-endian)
+ *
+ * The packet sequence number is owned by the caller and advanced once per
+ * datagram. Timetags are NTP 32.32 fixed point (see ntpTimetag()) and only
+ * used in bundle mode.
+ *
+ * Nothing here touches the Arduino core, so the native tests run the same
+ * encoders through a LoopbackTransport.
+ */
+#ifndef SAMPLE_ENCODER_H
+#define SAMPLE_ENCODER_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OSCFrame.h"
+#include "OSCTransport.h"
+
+#define SAMPLE_ENCODER_MAX_BATCH 32
+#define IMU_BLOB_HEADER 8
+#define IMU_BLOB_SAMPLE 12
+
+struct ImuSample {
+  int64_t timestampUs; // esp_timer time of the read
+  uint32_t seq;        // sample number, counted by the sampling task
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+#ifdef OUTPUT_ORIENTATION
+  bool hasQuat;   // a DMP packet arrived with this sample (every sample with OUTPUT_AHRS)
+  float quat[4];  // w, x, y, z
+#endif
+};
+
+/**
+ * @brief Converts microseconds since epochSeconds before 1900 (NTP era 0) to an OSC timetag.
+ */
+inline uint64_t ntpTimetag(uint64_t us, uint32_t epochSeconds) {
+  uint32_t seconds = (uint32_t)(us / 1000000ULL) + epochSeconds;
+  uint32_t fraction = (uint32_t)(((us % 1000000ULL) << 32) / 1000000ULL);
+  return ((uint64_t)seconds << 32) | fraction;
+}
+
+inline void setFrameTimetag(OSCFrame& frame, uint64_t timetag) {
+  frame.setTimetag((uint32_t)(timetag >> 32), (uint32_t)timetag);
+}
+
+class SampleEncoder {
+public:
+  SampleEncoder() : _bundle(false), _accSlot(0), _gyrSlot(0) {}
+
+  void begin(bool bundle) {
+    _bundle = bundle;
+    if (_bundle) {
+      _acc.begin(true);
+      _accSlot = _acc.addMessage("/acc", "fffih");
+      _gyrSlot = _acc.addMessage("/gyr", "fffih");
+    } else {
+      _acc.begin();
+      _accSlot = _acc.addMessage("/acc", "fffih");
+      _gyr.begin();
+      _gyrSlot = _gyr.addMessage("/gyr", "fffih");
+    }
+  }
+
+  /**
+   * @brief Sends one sample; in bundle mode /acc and /gyr share one datagram, its sequence number and timetag.
+   */
+  void send(OSCTransport& transport, const ImuSample& sample, uint32_t& packetSeq, uint64_t timetag) {
+    OSCFrame& gyr = _bundle ? _acc : _gyr;
+    _acc.setFloat(_accSlot + 0, sample.ax);
+    _acc.setFloat(_accSlot + 1, sample.ay);
+    _acc.setFloat(_accSlot + 2, sample.az);
+    _acc.setInt(_accSlot + 3, ++packetSeq);
+    _acc.setInt64(_accSlot + 4, sample.timestampUs);
+    gyr.setFloat(_gyrSlot + 0, sample.gx);
+    gyr.setFloat(_gyrSlot + 1, sample.gy);
+    gyr.setFloat(_gyrSlot + 2, sample.gz);
+    if (!_bundle) packetSeq++;
+    gyr.setInt(_gyrSlot + 3, packetSeq);
+    gyr.setInt64(_gyrSlot + 4, sample.timestampUs);
+    if (_bundle) {
+      setFrameTimetag(_acc, timetag);
+      transport.send(_acc.data(), _acc.size());
+    } else {
+      transport.send(_acc.data(), _acc.size());
+      transport.send(_gyr.data(), _gyr.size());
+    }
+  }
+
+private:
+  OSCFrame _acc; // the whole bundle in bundle mode
+  OSCFrame _gyr;
+  bool _bundle;
+  int _accSlot, _gyrSlot;
+};
+
+class BatchEncoder {
+public:
+  BatchEncoder() : _bundle(false), _slot(0), _count(0) {}
+
+  /**
+   * @brief Lays out a /batch message for count samples.
+   *
+   * @return false if count samples do not fit in OSC_FRAME_SIZE.
+   */
+  bool begin(bool bundle, int count) {
+    char typetags[3 + 6 * SAMPLE_ENCODER_MAX_BATCH + 1];
+    if (count < 1 || count > SAMPLE_ENCODER_MAX_BATCH) return false;
+    memcpy(typetags, "hii", 3);
+    memset(typetags + 3, 'f', 6 * count);
+    typetags[3 + 6 * count] = '\0';
+    _bundle = bundle;
+    _frame.begin(bundle);
+    _slot = _frame.addMessage("/batch", typetags);
+    _count = count;
+    return _frame.ok();
+  }
+
+  /**
+   * @brief Sends count consecutive samples as one /batch packet, timetagged with the first sample.
+   */
+  void send(OSCTransport& transport, const ImuSample* samples, int count, uint32_t intervalUs,
+            uint32_t& packetSeq, uint64_t timetag) {
+    // Short batches (after a gap) are rare, relaying out the frame is cheap and heap-free
+    if (count != _count) begin(_bundle, count);
+    _frame.setInt64(_slot, samples[0].timestampUs);
+    _frame.setInt(_slot + 1, intervalUs);
+    _frame.setInt(_slot + 2, ++packetSeq);
+    int slot = _slot + 3;
+    for (int i = 0; i < count; i++) {
+      _frame.setFloat(slot++, samples[i].ax);
+      _frame.setFloat(slot++, samples[i].ay);
+      _frame.setFloat(slot++, samples[i].az);
+      _frame.setFloat(slot++, samples[i].gx);
+      _frame.setFloat(slot++, samples[i].gy);
+      _frame.setFloat(slot++, samples[i].gz);
+    }
+    if (_bundle) setFrameTimetag(_frame, timetag);
+    transport.send(_frame.data(), _frame.size());
+  }
+
+private:
+  OSCFrame _frame;
+  bool _bundle;
+  int _slot;
+  int _count; // samples the current layout holds
+};
+
+class ImuBlobEncoder {
+public:
+  ImuBlobEncoder() : _bundle(false), _slot(0), _count(0) {}
+
+  /**
+   * @brief Lays out an /imu message for count samples.
+   *
+   * @return false if count samples do not fit in OSC_FRAME_SIZE.
+   */
+  bool begin(bool bundle, int count) {
+    _bundle = bundle;
+    _frame.begin(bundle);
+    _slot = _frame.addMessage("/imu", "hib", IMU_BLOB_HEADER + count * IMU_BLOB_SAMPLE);
+    _count = count;
+    return _frame.ok();
+  }
+
+  /**
+   * @brief Sends count consecutive samples as one /imu packet of int16 axes,
+   * 12 bytes per sample instead of 24 as floats (plus per-message overhead).
+   */
+  void send(OSCTransport& transport, const ImuSample* samples, int count, uint32_t intervalUs,
+            uint32_t& packetSeq, uint64_t timetag) {
+    if (count != _count) begin(_bundle, count);
+    _frame.setInt64(_slot, samples[0].timestampUs);
+    _frame.setInt(_slot + 1, ++packetSeq);
+    uint8_t* p = _frame.blob(_slot + 2);
+    putLE16(p, (uint16_t)samples[0].seq);
+    putLE16(p + 2, (uint16_t)(samples[0].seq >> 16));
+    putLE16(p + 4, (uint16_t)count);
+    putLE16(p + 6, (uint16_t)intervalUs);
+    p += IMU_BLOB_HEADER;
+    for (int i = 0; i < count; i++, p += IMU_BLOB_SAMPLE) {
+      putLE16(p + 0, samples[i].ax);
+      putLE16(p + 2, samples[i].ay);
+      putLE16(p + 4, samples[i].az);
+      putLE16(p + 6, samples[i].gx);
+      putLE16(p + 8, samples[i].gy);
+      putLE16(p + 10, samples[i].gz);
+    }
+    if (_bundle) setFrameTimetag(_frame, timetag);
+    transport.send(_frame.data(), _frame.size());
+  }
+
+private:
+  static void putLE16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+
+  OSCFrame _frame;
+  bool _bundle;
+  int _slot;
+  int _count;
+};
+
+#endif
@@ -4,30 +4,176 @@
 #include <Wire.h>
 #include <MPU6050.h> // Electronic Cats library
 #include <WebServer.h>
+#include <esp_timer.h>
+// Room for a /batch of up to 32 samples (6 floats each) in one datagram
+#define OSC_FRAME_SIZE 1400
+#define OSC_FRAME_MAX_SLOTS 200
+#include "OSCFrame.h"
+#include "OSCDestinations.h"
+#include "SampleRing.h"
+#include "FixedRateSampler.h"
+#include "DeadBand.h"
+#include "OSCTransport.h"
+#include "ClockSync.h"
+#include "MpuRaw.h"
+#include "MpuFifo.h"
+#include "Ahrs.h"
+#include "MpuCalibration.h"
 
-#define OUTPUT_TEAPOT
+//#define OUTPUT_TEAPOT // load the MPU6050 DMP and send its orientation as /quat and /ypr
+#define DMP_RATE_HZ 100 // MotionApps20 packet rate; with MPU_INT_PIN it is also the sample rate
+//#define OUTPUT_AHRS // fuse accel and gyro on the ESP32 at the sampling rate (Mahony) and send /quat and /ypr, instead of OUTPUT_TEAPOT
+//#define AHRS_FIXED_POINT // run the AHRS filter in Q30 fixed point instead of float
+#define OSC_BUNDLE_MODE // pack /acc and /gyr of one sample into a single timetagged bundle
+#define SAMPLE_RATE_HZ 100 // boot sampling rate, 50..1000 Hz (settable from the web page)
+#define MPU_INT_PIN 19 // MPU6050 INT; its data-ready pulse paces sampling (comment out to pace with a timer)
+//#define MPU_FIFO // let the MPU6050 queue samples in its FIFO and drain it in bursts (takes over from MPU_INT_PIN)
+#define MPU_FIFO_DRAIN_MS 20 // how often the FIFO is drained; it holds 85 samples
+#define OSC_BATCH_SIZE 1 // samples per /batch packet (up to 32, e.g. 10 with osc_to_midi.py); 1 sends every sample as /acc + /gyr
+//#define OSC_IMU_BLOB // send batches as /imu packed int16 blobs instead of float /acc /gyr /batch
+//#define OSC_DEADBAND // skip packets whose axes all stay within a threshold of the last one sent
+#define DEADBAND_ACC_COUNTS 200 // ~0.012 g at +-2 g (settable from the web page)
+#define DEADBAND_GYR_COUNTS 150 // ~1.1 deg/s at +-250 deg/s
+#define DEADBAND_HEARTBEAT_MS 1000 // keyframe period while nothing moves
+//#define OSC_TRANSPORT_SERIAL // send OSC SLIP-framed over USB serial instead of WiFi UDP
+#define OSC_SERIAL_BAUD 921600 // serial transport baud rate (2000000 works with most USB bridges)
+//#define OSC_CLOCK_SYNC // ping the receiver and stamp bundles in its clock (needs osc_to_midi.py to answer)
+#define CLOCK_SYNC_INTERVAL_MS 1000 // one /sync/ping per second
+#define OSC_LOCAL_PORT 9000 // with OSC_CLOCK_SYNC, the UDP port the socket is bound to; /sync/pong comes back here
+#define I2C_CLOCK_HZ 400000 // MPU6050 fast mode; a 14-byte motion read takes ~0.4 ms instead of ~1.6 ms at 100 kHz
+//#define MPU_BUS_BENCHMARK // time the MPU6050 read variants on the bus at boot
+#define SAMPLE_RING_DEPTH 32 // samples buffered between the sampling and network tasks (power of two)
+#define NETWORK_TASK_CORE 0 // WiFi stack core
+#define SAMPLING_TASK_CORE 1 // same core as loop(), at a higher priority
 #define LED_BUILTIN 2
 #define BUTTON_PIN 18
 
+#ifdef OUTPUT_TEAPOT
+#ifdef MPU_FIFO
+#error "The DMP streams its packets through the MPU6050 FIFO; undefine MPU_FIFO or OUTPUT_TEAPOT"
+#endif
+#include <MPU6050_6Axis_MotionApps20.h> // DMP firmware image and fusion helpers on top of MPU6050.h
+#define OUTPUT_ORIENTATION
+#endif
+#ifdef OUTPUT_AHRS
+#ifdef OUTPUT_TEAPOT
+#error "OUTPUT_AHRS and OUTPUT_TEAPOT both send /quat and /ypr; undefine one of them"
+#endif
+#define OUTPUT_ORIENTATION
+#endif
+#include "SampleEncoder.h" // after OUTPUT_ORIENTATION, which adds the quaternion to ImuSample
+
 // WiFi credentials
-WiFiUDP Udp1, Udp2; // Multiple UDP instances
+WiFiUDP Udp; // single socket shared by every destination
 const char* ssid = "CUCA_BELUDO";
 const char* password = "cuca_areka";
 
 // OSC server addresses and ports
 String oscServerIp = "192.168.0.10";
+IPAddress oscServerAddress; // oscServerIp resolved once, when it is set
 const int oscServerPort1 = 8000;
 const int oscServerPort2 = 8001;
+// Every packet is encoded once and fanned out to all of these (editable from the web page)
+OSCDestinations destinations;
+// Multicast/broadcast output: one datagram reaches every listener on the LAN
+IPAddress oscMulticastGroup(239, 0, 0, 57);
+const int oscMulticastPort = 8000;
+const OSCOutputMode oscOutputMode = OSC_OUTPUT_UNICAST; // mode used at boot
+OSCOutputMode outputMode = oscOutputMode;
+// Every encoded packet leaves through one transport; setOutputMode() picks the UDP one
+UdpTransport udpTransport(Udp, destinations);
+UdpMulticastTransport multicastTransport(Udp, destinations);
+OSCTransport* volatile udpOutput = &udpTransport; // UDP side of the output mode, also used for clock sync
+#ifdef OSC_TRANSPORT_SERIAL
+SlipSerialTransport serialTransport(Serial);
+OSCTransport* volatile transport = &serialTransport;
+#else
+OSCTransport* volatile transport = &udpTransport;
+#endif
+
+/**
+ * @brief Swallows status output.
+ */
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+// Status and debug text; the UART carries the SLIP stream in serial builds, so it goes nowhere there
+#ifdef OSC_TRANSPORT_SERIAL
+NullPrint nullLog;
+Print& logOut = nullLog;
+#else
+Print& logOut = Serial;
+#endif
+
+// Sample packets are preencoded once; only the float slots change per sample
+#ifdef OSC_BUNDLE_MODE
+const bool oscBundleMode = true;
+#else
+const bool oscBundleMode = false;
+#endif
+SampleEncoder sampleEncoder;
+#if OSC_BATCH_SIZE > 1
+BatchEncoder batchEncoder;
+#endif
+#ifdef OSC_IMU_BLOB
+ImuBlobEncoder imuEncoder;
+#endif
+#ifdef OUTPUT_ORIENTATION
+// /quat ,ffffih: w, x, y, z; /ypr ,fffih: yaw, pitch, roll in degrees; both then packet seq and device time (us)
+#ifdef OSC_BUNDLE_MODE
+OSCFrame orientationFrame;
+#else
+OSCFrame quatFrame, yprFrame;
+#endif
+int quatSlot, yprSlot;
+#endif
+#ifdef OUTPUT_AHRS
+// Owned by the sampling task
+#ifdef AHRS_FIXED_POINT
+MahonyAhrsQ30 ahrs;
+#else
+MahonyAhrs ahrs;
+#endif
+volatile uint32_t ahrsCycles = 0; // CPU cycles of the last filter update
+#endif
+#ifdef OUTPUT_TEAPOT
+bool dmpReady = false;
+uint8_t dmpPacket[64]; // one MotionApps20 FIFO packet (42 bytes)
+#endif
+OSCFrame optFrame;
+#ifdef OSC_CLOCK_SYNC
+OSCFrame pingFrame; // /sync/ping ,h: device time (us) the ping left
+ClockSync clockSync; // owned by the network task
+#endif
 
-OSCMessage gyr("/gyr");
-OSCMessage acc("/acc");
-OSCMessage optMsg("/opt");
+// The sampling task produces samples, the network task encodes and sends them
+SampleRing<ImuSample, SAMPLE_RING_DEPTH> sampleRing;
+static_assert(OSC_BATCH_SIZE >= 1 && OSC_BATCH_SIZE <= 32 && OSC_BATCH_SIZE <= SAMPLE_RING_DEPTH,
+              "OSC_BATCH_SIZE must be 1..32 and fit in the sample ring");
+FixedRateSampler sampler;
+volatile uint32_t requestedRateHz = SAMPLE_RATE_HZ;
+TaskHandle_t networkTaskHandle = NULL;
+volatile uint32_t samplesSent = 0;
+uint32_t packetSeq = 0; // per-datagram sequence number, owned by the network task
+#ifdef OSC_DEADBAND
+DeadBand deadBand;
+#endif
+volatile int pendingOpt = 0; // /opt value waiting for the network task, 0 = none
 int buttonCounter = 1;
 unsigned long lastButtonPress = 0;
 const unsigned long debounceDelay = 50;
 
 // Create an Electronic Cats MPU6050 object
 MPU6050 mpu;
+MpuRaw mpuRaw; // 14-byte burst reads of the motion registers
+MpuCalibration calibration(mpuRaw); // offsets in the sensor's own registers, kept in NVS
+volatile bool calibrationRequested = false; // run by the sampling task, which owns the bus
+#ifdef MPU_FIFO
+MpuFifo mpuFifo(mpuRaw);
+#endif
 
 WebServer server(80);
 
@@ -38,36 +184,742 @@ void handleRoot() {
                 "OSC Server IP: <input type='text' name='ip' value='" + oscServerIp + "'>"
                 "<input type='submit' value='Update'>"
                 "</form>"
-                "</body></html>";
+                "<h2>OSC Destinations</h2><ul>";
+  for (int i = 0; i < destinations.count(); i++) {
+    html += "<li>" + destinations[i].ip.toString() + ":" + String(destinations[i].port) +
+            " <form style='display:inline' action='/deldest' method='POST'>"
+            "<input type='hidden' name='index' value='" + String(i) + "'>"
+            "<input type='submit' value='Remove'></form></li>";
+  }
+  html += "</ul>"
+          "<form action='/adddest' method='POST'>"
+          "IP: <input type='text' name='ip' value='" + oscServerIp + "'> "
+          "Port: <input type='number' name='port' min='1' max='65535'>"
+          "<input type='submit' value='Add'>"
+          "</form>"
+          "<h2>Sampling</h2>"
+          "<form action='/setrate' method='POST'>"
+          "Rate (Hz): <input type='number' name='rate' min='50' max='1000' value='" + String((int)requestedRateHz) + "'>"
+          "<input type='submit' value='Set'>"
+          "</form>"
+          "<form action='/calibrate' method='POST'>"
+          "Calibration: " + String(calibration.statusText()) + " "
+          "<input type='submit' value='Calibrate (lay the sensor flat and still)'>"
+          "</form>"
+#ifdef OSC_DEADBAND
+          "<h2>Dead-band</h2>"
+          "<form action='/setdeadband' method='POST'>"
+          "Acc (counts): <input type='number' name='acc' min='0' max='32767' value='" + String(deadBand.accThreshold()) + "'> "
+          "Gyr (counts): <input type='number' name='gyr' min='0' max='32767' value='" + String(deadBand.gyrThreshold()) + "'> "
+          "Heartbeat (ms): <input type='number' name='heartbeat' min='10' max='60000' value='" + String(deadBand.heartbeatMs()) + "'>"
+          "<input type='submit' value='Set'>"
+          "</form>"
+#endif
+          "<h2>Output Mode</h2>"
+          "<form action='/setmode' method='POST'>"
+          "<select name='mode'>"
+          "<option value='unicast'" + String(outputMode == OSC_OUTPUT_UNICAST ? " selected" : "") + ">Unicast (destination list)</option>"
+          "<option value='multicast'" + String(outputMode == OSC_OUTPUT_MULTICAST ? " selected" : "") + ">Multicast</option>"
+          "<option value='broadcast'" + String(outputMode == OSC_OUTPUT_BROADCAST ? " selected" : "") + ">Broadcast</option>"
+          "</select> "
+          "Group: <input type='text' name='group' value='" + oscMulticastGroup.toString() + "'>"
+          "<input type='submit' value='Set'>"
+          "</form>"
+          "</body></html>";
   server.send(200, "text/html", html);
 }
 
+void redirectToRoot() {
+  server.sendHeader("Location", "/", true);
+  server.send(302, "text/plain", "");
+}
+
 void handleSetIp() {
   if (server.hasArg("ip")) {
+    IPAddress ip;
+    if (!OSCDestinations::resolve(server.arg("ip"), ip)) {
+      server.send(400, "text/plain", "Invalid IP address or unknown host: " + server.arg("ip"));
+      return;
+    }
     oscServerIp = server.arg("ip");
+    // Only the primary listeners follow; hosts added with /adddest keep their address
+    destinations.replaceIp(oscServerAddress, ip);
+    oscServerAddress = ip;
   }
-  server.sendHeader("Location", "/", true);
-  server.send(302, "text/plain", "");
+  redirectToRoot();
+}
+
+void handleAddDestination() {
+  if (server.hasArg("ip") && server.hasArg("port")) {
+    IPAddress ip;
+    int port = server.arg("port").toInt();
+    if (!OSCDestinations::resolve(server.arg("ip"), ip) || port <= 0 || port > 65535) {
+      server.send(400, "text/plain", "Invalid destination: " + server.arg("ip") + ":" + server.arg("port"));
+      return;
+    }
+    destinations.add(ip, port);
+  }
+  redirectToRoot();
+}
+
+void handleRemoveDestination() {
+  if (server.hasArg("index")) {
+    destinations.remove(server.arg("index").toInt());
+  }
+  redirectToRoot();
+}
+
+/**
+ * @brief Switches between the unicast destination table and a single multicast/broadcast send.
+ *
+ * Serial builds keep their transport; the choice applies once they go back to UDP.
+ */
+void setOutputMode(OSCOutputMode mode) {
+  OSCTransport* udp = &udpTransport;
+  if (mode == OSC_OUTPUT_MULTICAST) {
+    multicastTransport.setGroup(oscMulticastGroup, oscMulticastPort);
+    udp = &multicastTransport;
+  } else if (mode == OSC_OUTPUT_BROADCAST) {
+    multicastTransport.setGroup(WiFi.broadcastIP(), oscMulticastPort, true);
+    udp = &multicastTransport;
+  }
+  outputMode = mode;
+  udpOutput = udp;
+#ifndef OSC_TRANSPORT_SERIAL
+  transport = udp;
+#endif
+}
+
+/**
+ * @brief Reports the per-datagram send timing counters as plain text; "?reset" clears them.
+ */
+void handleStats() {
+  const OSCSendStats& stats = destinations.stats();
+  SamplerJitterStats jitter = sampler.stats();
+  String text = "transport: " + String(transport->name()) +
+                "\nsamples produced: " + String(sampleRing.produced()) +
+                "\nsamples sent: " + String(samplesSent) +
+                "\nsamples dropped: " + String(sampleRing.dropped()) +
+                "\ni2c read errors: " + String(mpuRaw.errors()) +
+                "\ncalibration: " + String(calibration.statusText()) +
+#ifdef OUTPUT_AHRS
+                "\nahrs cycles/update: " + String(ahrsCycles) +
+#endif
+#ifdef MPU_FIFO
+                "\nfifo frames: " + String(mpuFifo.frames()) +
+                "\nfifo overflows: " + String(mpuFifo.overflows()) +
+#endif
+#ifdef OSC_DEADBAND
+                "\nsamples skipped (dead-band): " + String(deadBand.skipped()) +
+                "\nkeyframes: " + String(deadBand.keyframes()) +
+#endif
+                "\nring depth: " + String((int)sampleRing.size()) + "/" + String((int)sampleRing.capacity()) +
+                "\nsample rate Hz: " + String(jitter.periodUs ? 1000000UL / jitter.periodUs : 0) +
+                "\nmean interval us: " + String(jitter.meanIntervalUs) +
+                "\ninterval stddev us: " + String(jitter.stddevUs) +
+                "\nmax deviation us: " + String(jitter.maxDeviationUs) +
+                "\nmissed ticks: " + String(jitter.missedTicks) +
+#ifdef MPU_INT_PIN
+                "\ndata-ready timeouts: " + String(jitter.edgeTimeouts) +
+#endif
+                "\npackets: " + String(stats.packets) +
+                "\nfailures: " + String(stats.failures) +
+                "\navg send us: " + String(stats.averageMicros()) +
+                "\nmax send us: " + String(stats.maxMicros) +
+#ifdef OSC_CLOCK_SYNC
+                "\nclock synced: " + String(clockSync.synced() ? "yes" : "no") +
+                "\nclock offset us: " + String((long)(clockSync.offsetUs() % 1000000000LL)) + " (mod 1000 s)" +
+                "\nclock drift ppm: " + String(clockSync.driftPpm()) +
+                "\nsync rtt us: " + String(clockSync.rttUs()) +
+                "\nsync exchanges: " + String(clockSync.exchanges()) +
+#endif
+#ifdef OSC_TRANSPORT_SERIAL
+                "\nserial frames: " + String(serialTransport.frames()) +
+                "\nserial bytes: " + String(serialTransport.bytes()) +
+#endif
+                "\n";
+  if (server.hasArg("reset")) {
+    destinations.resetStats();
+#ifdef OSC_DEADBAND
+    deadBand.resetStats();
+#endif
+  }
+  server.send(200, "text/plain", text);
+}
+
+void handleSetRate() {
+  int rate = server.arg("rate").toInt();
+  if (rate < SAMPLER_MIN_RATE_HZ || rate > SAMPLER_MAX_RATE_HZ) {
+    server.send(400, "text/plain", "Sample rate must be 50..1000 Hz");
+    return;
+  }
+#if defined(OUTPUT_TEAPOT) && defined(MPU_INT_PIN)
+  if (dmpReady) {
+    server.send(400, "text/plain", "The DMP paces sampling at " + String(DMP_RATE_HZ) + " Hz");
+    return;
+  }
+#endif
+  requestedRateHz = rate; // applied by the sampling task on its next tick
+  redirectToRoot();
+}
+
+void handleCalibrate() {
+  calibrationRequested = true; // done by the sampling task, about 2 s without samples
+  redirectToRoot();
+}
+
+#ifdef OSC_DEADBAND
+void handleSetDeadBand() {
+  int acc = server.arg("acc").toInt();
+  int gyr = server.arg("gyr").toInt();
+  int heartbeat = server.arg("heartbeat").toInt();
+  if (acc < 0 || acc > 32767 || gyr < 0 || gyr > 32767 || heartbeat < 10 || heartbeat > 60000) {
+    server.send(400, "text/plain", "Thresholds must be 0..32767 counts, heartbeat 10..60000 ms");
+    return;
+  }
+  deadBand.setThresholds(acc, gyr);
+  deadBand.setHeartbeatMs(heartbeat);
+  redirectToRoot();
+}
+#endif
+
+void handleSetMode() {
+  if (server.hasArg("group") && server.arg("group").length() > 0) {
+    IPAddress group;
+    if (!group.fromString(server.arg("group")) || group[0] < 224 || group[0] > 239) {
+      server.send(400, "text/plain", "Invalid multicast group: " + server.arg("group"));
+      return;
+    }
+    oscMulticastGroup = group;
+  }
+  String mode = server.arg("mode");
+  if (mode == "multicast") {
+    setOutputMode(OSC_OUTPUT_MULTICAST);
+  } else if (mode == "broadcast") {
+    setOutputMode(OSC_OUTPUT_BROADCAST);
+  } else {
+    setOutputMode(OSC_OUTPUT_UNICAST);
+  }
+  redirectToRoot();
+}
+
+void sendFrame(const OSCFrame& frame) {
+  transport->send(frame.data(), frame.size());
 }
 
 void sendOptOSC(int value) {
-  optMsg.empty();
-  optMsg.add((int32_t)value);
-  Udp1.beginPacket(oscServerIp.c_str(), oscServerPort1);
-  optMsg.send(Udp1);
-  Udp1.endPacket();
-  optMsg.empty();
-  Udp2.beginPacket(oscServerIp.c_str(), oscServerPort2);
-  optMsg.send(Udp2);
-  Udp2.endPacket();
-  optMsg.empty();
+  optFrame.setInt(0, value);
+  sendFrame(optFrame);
+}
+
+/**
+ * @brief Hands a /opt value to the network task, which owns the UDP socket.
+ */
+void queueOptOSC(int value) {
+  pendingOpt = value;
+  if (networkTaskHandle) xTaskNotifyGive(networkTaskHandle);
+}
+
+/**
+ * Builds the fixed layout of the sample packets: addresses, type tags and padding.
+ *
+ * /acc and /gyr carry x, y, z followed by the packet sequence number and the
+ * device timestamp in microseconds, so receivers can account for loss and jitter.
+ */
+void setupOSCFrames() {
+  sampleEncoder.begin(oscBundleMode);
+#if OSC_BATCH_SIZE > 1
+  if (!batchEncoder.begin(oscBundleMode, OSC_BATCH_SIZE)) logOut.println("OSC_BATCH_SIZE does not fit in OSC_FRAME_SIZE");
+#endif
+#ifdef OSC_IMU_BLOB
+  imuEncoder.begin(oscBundleMode, OSC_BATCH_SIZE);
+#endif
+#ifdef OUTPUT_ORIENTATION
+#ifdef OSC_BUNDLE_MODE
+  orientationFrame.begin(true);
+  quatSlot = orientationFrame.addMessage("/quat", "ffffih");
+  yprSlot = orientationFrame.addMessage("/ypr", "fffih");
+#else
+  quatFrame.begin();
+  quatSlot = quatFrame.addMessage("/quat", "ffffih");
+  yprFrame.begin();
+  yprSlot = yprFrame.addMessage("/ypr", "fffih");
+#endif
+#endif
+  optFrame.begin();
+  optFrame.addMessage("/opt", "i");
+#ifdef OSC_CLOCK_SYNC
+  pingFrame.begin();
+  pingFrame.addMessage("/sync/ping", "h");
+#endif
 }
 
+/**
+ * Converts a sample time into an OSC timetag (NTP format: seconds + 2^-32 fractions).
+ *
+ * Once the clock sync has an estimate the timetag is the receiver's wall-clock
+ * time of the sample; before that it is the time since boot.
+ */
+uint64_t sampleTimetag(int64_t deviceUs) {
+#ifdef OSC_CLOCK_SYNC
+  if (clockSync.synced()) return ntpTimetag(clockSync.hostUs(deviceUs), NTP_UNIX_OFFSET);
+#endif
+  return ntpTimetag(deviceUs, 0);
+}
+
+/**
+ * Sends one sample as /acc and /gyr; with OSC_BUNDLE_MODE both go in a single
+ * bundle under the same timetag, so each destination costs one datagram
+ * instead of two and the receiver can line both up.
+ */
+void sendOSCMessages(const ImuSample& sample) {
+  sampleEncoder.send(*transport, sample, packetSeq, sampleTimetag(sample.timestampUs));
+}
+
+#if OSC_BATCH_SIZE > 1
+/**
+ * Sends count consecutive samples as one /batch packet, timetagged with the first sample.
+ */
+void sendOSCBatch(const ImuSample* batch, int count) {
+  batchEncoder.send(*transport, batch, count, sampler.periodUs(), packetSeq, sampleTimetag(batch[0].timestampUs));
+}
+#endif
+
+#ifdef OSC_IMU_BLOB
+/**
+ * Sends count consecutive samples as one /imu packet of raw int16 counts.
+ */
+void sendOSCImu(const ImuSample* samples, int count) {
+  imuEncoder.send(*transport, samples, count, sampler.periodUs(), packetSeq, sampleTimetag(samples[0].timestampUs));
+}
+#endif
+
+#ifdef OUTPUT_ORIENTATION
+/**
+ * Sends the orientation of a sample (from the DMP or the AHRS filter): /quat
+ * as is and /ypr derived from it through the gravity vector, the way the
+ * teapot demo does.
+ */
+void sendOrientation(const ImuSample& sample) {
+  float ypr[3];
+  quatToYawPitchRoll(sample.quat, ypr);
+#ifdef OSC_BUNDLE_MODE
+  OSCFrame& quatFrame = orientationFrame;
+  OSCFrame& yprFrame = orientationFrame;
+  packetSeq++;
+  uint32_t quatSeq = packetSeq, yprSeq = packetSeq;
+#else
+  uint32_t quatSeq = ++packetSeq, yprSeq = ++packetSeq;
+#endif
+  for (int i = 0; i < 4; i++) quatFrame.setFloat(quatSlot + i, sample.quat[i]);
+  quatFrame.setInt(quatSlot + 4, quatSeq);
+  quatFrame.setInt64(quatSlot + 5, sample.timestampUs);
+  for (int i = 0; i < 3; i++) yprFrame.setFloat(yprSlot + i, ypr[i] * (180 / M_PI));
+  yprFrame.setInt(yprSlot + 3, yprSeq);
+  yprFrame.setInt64(yprSlot + 4, sample.timestampUs);
+#ifdef OSC_BUNDLE_MODE
+  setFrameTimetag(orientationFrame, sampleTimetag(sample.timestampUs));
+  sendFrame(orientationFrame);
+#else
+  sendFrame(quatFrame);
+  sendFrame(yprFrame);
+#endif
+}
+#endif
+
+#ifdef OSC_DEADBAND
+static void sampleAxes(const ImuSample& sample, int16_t v[6]) {
+  v[0] = sample.ax;
+  v[1] = sample.ay;
+  v[2] = sample.az;
+  v[3] = sample.gx;
+  v[4] = sample.gy;
+  v[5] = sample.gz;
+}
+
+/**
+ * @brief Decides whether a packet of samples goes out at all.
+ *
+ * The packet is sent when any of its samples moved past the dead-band, or as a
+ * keyframe once the heartbeat period passed; otherwise receivers keep holding
+ * the last values and the packet is skipped. Skipped packets do not use up a
+ * sequence number, so they never look like loss.
+ */
+bool passDeadBand(const ImuSample* samples, int count) {
+  int16_t v[6];
+  bool moved = false;
+  for (int i = 0; i < count && !moved; i++) {
+    sampleAxes(samples[i], v);
+    moved = deadBand.moved(v);
+  }
+  int64_t now = samples[count - 1].timestampUs;
+  if (!moved && !deadBand.keyframeDue(now)) {
+    deadBand.skip(count);
+    return false;
+  }
+  sampleAxes(samples[count - 1], v);
+  deadBand.sent(v, now, !moved);
+  return true;
+}
+#endif
+
+/**
+ * Sends a run of consecutive samples in the configured wire format.
+ */
+void sendSamples(const ImuSample* samples, int count) {
+#ifdef OSC_DEADBAND
+  if (!passDeadBand(samples, count)) return;
+#endif
+#if defined(OSC_IMU_BLOB)
+  sendOSCImu(samples, count);
+#elif OSC_BATCH_SIZE > 1
+  sendOSCBatch(samples, count);
+#else
+  sendOSCMessages(samples[0]);
+#endif
+#ifdef OUTPUT_ORIENTATION
+  // The packet's orientation is the newest quaternion among its samples
+  for (int i = count - 1; i >= 0; i--) {
+    if (samples[i].hasQuat) {
+      sendOrientation(samples[i]);
+      break;
+    }
+  }
+#endif
+  samplesSent += count;
+}
+
+#ifdef OSC_CLOCK_SYNC
+/**
+ * @brief Sends a /sync/ping when one is due and folds any /sync/pong into the clock estimate.
+ *
+ * Pongs are only read when the network task wakes up (every sample), so t4 can
+ * be late by up to a sample period; the estimate keeps the lowest-RTT exchanges,
+ * which are also the ones read promptly.
+ */
+void serviceClockSync() {
+  static unsigned long lastPing = 0;
+  if (millis() - lastPing >= CLOCK_SYNC_INTERVAL_MS) {
+    lastPing = millis();
+    pingFrame.setInt64(0, esp_timer_get_time());
+    udpOutput->send(pingFrame.data(), pingFrame.size());
+  }
+  while (int size = Udp.parsePacket()) {
+    int64_t t4 = esp_timer_get_time();
+    uint8_t buffer[64];
+    int n = Udp.read(buffer, sizeof(buffer));
+    int64_t t1, t2, t3;
+    if (n == size && ClockSync::parsePong(buffer, n, t1, t2, t3)) {
+      clockSync.addExchange(t1, t2, t3, t4);
+    }
+  }
+}
+#endif
+
+/**
+ * @brief Drains the sample ring and sends each sample, pinned to the WiFi core.
+ *
+ * Runs apart from loop() so a stalled endPacket() only delays the network side;
+ * sampling keeps its pace and the ring drops the oldest samples if it fills up.
+ */
+void networkTask(void* parameter) {
+  ImuSample sample;
+  ImuSample batch[OSC_BATCH_SIZE];
+  int batchCount = 0;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+#ifdef OSC_CLOCK_SYNC
+    serviceClockSync();
+#endif
+    int opt = pendingOpt;
+    if (opt) {
+      pendingOpt = 0;
+      sendOptOSC(opt);
+    }
+    while (sampleRing.pop(sample)) {
+      // A gap (dropped samples) ends the batch early so its fixed interval stays true
+      if (batchCount > 0 && sample.seq != batch[batchCount - 1].seq + 1) {
+        sendSamples(batch, batchCount);
+        batchCount = 0;
+      }
+      batch[batchCount++] = sample;
+      if (batchCount == OSC_BATCH_SIZE) {
+        sendSamples(batch, batchCount);
+        batchCount = 0;
+      }
+    }
+  }
+}
+
+#if defined(MPU_INT_PIN) || defined(MPU_FIFO)
+/**
+ * @brief Sets up the MPU6050 sample clock and, unless the FIFO is used, makes INT pulse once per new sample.
+ *
+ * The DLPF at 188 Hz puts the internal sample clock at 1 kHz, which the
+ * sample-rate divider then divides down (see setMpuRate()).
+ */
+void setupMpuSampleClock() {
+#ifdef OUTPUT_TEAPOT
+  if (dmpReady) return; // dmpInitialize() set up its own clock and interrupt
+#endif
+  mpu.setDLPFMode(MPU6050_DLPF_BW_188);
+#ifndef MPU_FIFO
+  mpu.setInterruptMode(false);  // active high
+  mpu.setInterruptDrive(false); // push-pull
+  mpu.setInterruptLatch(false); // 50 us pulse, nothing to clear
+  mpu.setIntDataReadyEnabled(true);
+#endif
+}
+
+/**
+ * @brief Programs the sample-rate divider: rate = 1 kHz / (1 + divider).
+ *
+ * @return The rate the sensor actually runs at, e.g. 333 Hz for 300.
+ */
+uint32_t setMpuRate(uint32_t rateHz) {
+#ifdef OUTPUT_TEAPOT
+  // The DMP firmware owns the divider and INT pulses once per DMP packet
+  if (dmpReady) return DMP_RATE_HZ;
+#endif
+  if (rateHz < SAMPLER_MIN_RATE_HZ) rateHz = SAMPLER_MIN_RATE_HZ;
+  if (rateHz > SAMPLER_MAX_RATE_HZ) rateHz = SAMPLER_MAX_RATE_HZ;
+  uint8_t divider = (1000 + rateHz / 2) / rateHz - 1;
+  mpu.setRate(divider);
+  return 1000 / (divider + 1);
+}
+#endif
+
+#ifdef OUTPUT_TEAPOT
+/**
+ * @brief Loads the DMP firmware, which then fuses accel and gyro into a quaternion on the chip.
+ *
+ * dmpInitialize() sets what the DMP expects: +-2 g, +-2000 deg/s, the 42 Hz
+ * DLPF and a 200 Hz sample clock, with INT pulsing once per packet.
+ */
+void setupDmp() {
+  uint8_t status = mpu.dmpInitialize();
+  if (status != 0) {
+    logOut.printf("DMP initialization failed (%u), sending raw data only\n", status);
+    return;
+  }
+  mpu.setDMPEnabled(true);
+  dmpReady = true;
+  logOut.println("DMP ready");
+}
+
+/**
+ * @brief Reads the newest DMP packet, if one arrived, and returns its quaternion (w, x, y, z).
+ */
+bool readDmpQuaternion(float quat[4]) {
+  if (!dmpReady || !mpu.dmpGetCurrentFIFOPacket(dmpPacket)) return false;
+  Quaternion q;
+  mpu.dmpGetQuaternion(&q, dmpPacket);
+  quat[0] = q.w;
+  quat[1] = q.x;
+  quat[2] = q.y;
+  quat[3] = q.z;
+  return true;
+}
+#endif
+
+#ifdef OUTPUT_AHRS
+/**
+ * @brief Runs the AHRS filter on a sample and attaches the resulting quaternion.
+ */
+void fuseOrientation(ImuSample& sample) {
+  uint32_t start = ESP.getCycleCount();
+  ahrs.update(sample.ax, sample.ay, sample.az, sample.gx, sample.gy, sample.gz);
+  ahrsCycles = ESP.getCycleCount() - start;
+  ahrs.getQuaternion(sample.quat);
+  sample.hasQuat = true;
+}
+#endif
+
+/**
+ * @brief Measures and stores new zero offsets; the sensor must lie flat and still.
+ */
+void calibrateMpu() {
+  logOut.println("Calibrating MPU6050, keep it flat and still");
+  calibration.calibrate();
+  logOut.printf("MPU6050 calibration: %s\n", calibration.statusText());
+}
+
+#ifdef MPU_BUS_BENCHMARK
+/**
+ * Reads the motion registers many times through each access path and prints
+ * the average bus time per sample:
+ * - getAcceleration() + getRotation(): two transactions, as the firmware used to
+ * - getMotion6(): the library's own 14-byte burst
+ * - MpuRaw::read(): one 14-byte burst, no temperature decode
+ * - MpuRaw::readSplit(): two 6-byte transactions that skip temperature on the bus
+ */
+void benchmarkMpuReads() {
+  const int iterations = 1000;
+  int16_t ax, ay, az, gx, gy, gz;
+  MpuRawSample raw;
+
+  unsigned long start = micros();
+  for (int i = 0; i < iterations; i++) {
+    mpu.getAcceleration(&ax, &ay, &az);
+    mpu.getRotation(&gx, &gy, &gz);
+  }
+  unsigned long separateUs = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) mpu.getMotion6(&ax, &ay, &az, &gx, &gy, &gz);
+  unsigned long motion6Us = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) mpuRaw.read(raw);
+  unsigned long burstUs = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) mpuRaw.readSplit(raw);
+  unsigned long splitUs = micros() - start;
+
+  logOut.printf("MPU read @ %lu Hz I2C: acc+rot %lu us, getMotion6 %lu us, burst %lu us, split %lu us (errors %lu)\n",
+                (unsigned long)I2C_CLOCK_HZ, separateUs / iterations, motion6Us / iterations,
+                burstUs / iterations, splitUs / iterations, (unsigned long)mpuRaw.errors());
+}
+#endif
+
+#ifdef MPU_FIFO
+/**
+ * @brief Drains the MPU6050 FIFO every MPU_FIFO_DRAIN_MS and queues the samples found in it.
+ *
+ * The sensor clock spaces the samples, so their timestamps are counted back
+ * from the drain time by the sample period. After an overflow the samples
+ * the FIFO lost are skipped in seq, so receivers see the gap.
+ */
+void samplingTask(void* parameter) {
+  static MpuRawSample frames[MPU_FIFO_MAX_FRAMES];
+  uint32_t appliedRateHz = requestedRateHz;
+  sampler.setRate(setMpuRate(appliedRateHz)); // no timer, only records the rate
+#ifdef OUTPUT_AHRS
+  ahrs.begin(mpuRaw.gyroScale(), sampler.periodUs());
+#endif
+  mpuFifo.begin();
+  ImuSample sample;
+  sample.seq = 0;
+  int64_t lastDrainUs = esp_timer_get_time();
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(MPU_FIFO_DRAIN_MS));
+    int n = mpuFifo.drain(frames, MPU_FIFO_MAX_FRAMES);
+    int64_t now = esp_timer_get_time();
+    uint32_t periodUs = sampler.periodUs();
+    if (n < 0) sample.seq += (uint32_t)((now - lastDrainUs) / periodUs);
+    lastDrainUs = now;
+    for (int i = 0; i < n; i++) {
+      sample.timestampUs = now - (int64_t)(n - 1 - i) * periodUs;
+      sample.seq++;
+      sample.ax = frames[i].ax;
+      sample.ay = frames[i].ay;
+      sample.az = frames[i].az;
+      sample.gx = frames[i].gx;
+      sample.gy = frames[i].gy;
+      sample.gz = frames[i].gz;
+#ifdef OUTPUT_AHRS
+      // Samples lost to an overflow are not integrated; the accelerometer pulls tilt back
+      fuseOrientation(sample);
+#endif
+      sampleRing.push(sample);
+    }
+    if (n > 0) xTaskNotifyGive(networkTaskHandle);
+
+    // Changed right after a drain and without a FIFO reset, so nothing queued is lost;
+    // at most one frame still at the old rate gets stamped with the new period
+    if (requestedRateHz != appliedRateHz) {
+      appliedRateHz = requestedRateHz;
+      sampler.setRate(setMpuRate(appliedRateHz));
+#ifdef OUTPUT_AHRS
+      ahrs.setPeriodUs(sampler.periodUs());
+#endif
+    }
+    if (calibrationRequested) {
+      calibrationRequested = false;
+      calibrateMpu();
+      // What queued up meanwhile overflowed anyway; count it as lost like an overflow
+      mpuFifo.reset();
+      int64_t now = esp_timer_get_time();
+      sample.seq += (uint32_t)((now - lastDrainUs) / sampler.periodUs());
+      lastDrainUs = now;
+    }
+  }
+}
+#else
+/**
+ * @brief Reads the MPU6050 once per data-ready pulse (or sampler tick) and queues the timestamped sample.
+ */
+void samplingTask(void* parameter) {
+  uint32_t appliedRateHz = requestedRateHz;
+#ifdef MPU_INT_PIN
+  sampler.beginInterrupt(MPU_INT_PIN, setMpuRate(appliedRateHz));
+#else
+  sampler.begin(appliedRateHz);
+#endif
+#ifdef OUTPUT_AHRS
+  ahrs.begin(mpuRaw.gyroScale(), sampler.periodUs());
+#endif
+  ImuSample sample;
+  MpuRawSample raw;
+  sample.seq = 0;
+  for (;;) {
+    if (requestedRateHz != appliedRateHz) {
+      appliedRateHz = requestedRateHz;
+#ifdef MPU_INT_PIN
+      sampler.setRate(setMpuRate(appliedRateHz));
+#else
+      sampler.setRate(appliedRateHz);
+#endif
+#ifdef OUTPUT_AHRS
+      ahrs.setPeriodUs(sampler.periodUs());
+#endif
+    }
+    if (calibrationRequested) {
+      calibrationRequested = false;
+      calibrateMpu();
+    }
+    sample.timestampUs = sampler.wait();
+    sample.seq++;
+    // One burst for all six axes; a failed read is skipped (the seq gap shows it)
+    if (!mpuRaw.read(raw)) continue;
+    sample.ax = raw.ax;
+    sample.ay = raw.ay;
+    sample.az = raw.az;
+    sample.gx = raw.gx;
+    sample.gy = raw.gy;
+    sample.gz = raw.gz;
+#ifdef OUTPUT_TEAPOT
+    sample.hasQuat = readDmpQuaternion(sample.quat);
+#endif
+#ifdef OUTPUT_AHRS
+    fuseOrientation(sample);
+#endif
+
+    // Hand the sample to the network task; never blocks on WiFi
+    sampleRing.push(sample);
+    xTaskNotifyGive(networkTaskHandle);
+  }
+}
+#endif
+
 void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
   pinMode(BUTTON_PIN, INPUT_PULLUP);
+#ifdef OSC_TRANSPORT_SERIAL
+  // Room for a whole /batch so the network task rarely waits on the UART
+  Serial.setTxBufferSize(2048);
+  Serial.begin(OSC_SERIAL_BAUD);
+#else
   Serial.begin(115200);
+#endif
   Wire.begin();
+  Wire.setClock(I2C_CLOCK_HZ);
+  setupOSCFrames();
+#ifdef OSC_DEADBAND
+  deadBand.setThresholds(DEADBAND_ACC_COUNTS, DEADBAND_GYR_COUNTS);
+  deadBand.setHeartbeatMs(DEADBAND_HEARTBEAT_MS);
+#endif
 
   mpu.initialize();
   while (!mpu.testConnection()) {
@@ -75,61 +927,64 @@ void setup() {
     delay(250);
     digitalWrite(LED_BUILTIN, LOW); // Turn the LED off
     delay(300);
-    Serial.println("MPU6050 connection failed");
+    logOut.println("MPU6050 connection failed");
   }
-  Serial.println("MPU6050 connected!");
+  logOut.println("MPU6050 connected!");
+#ifdef OUTPUT_TEAPOT
+  setupDmp();
+#endif
+  mpuRaw.readScales(); // the ranges initialize() (or the DMP) left the chip in
+  // Stored offsets go straight back into the sensor; measuring new ones is left to /calibrate
+  if (calibration.load()) logOut.println("MPU6050 calibration loaded");
+  else logOut.println("MPU6050 not calibrated, use Calibrate on the web page with it flat and still");
+#if defined(MPU_INT_PIN) || defined(MPU_FIFO)
+  setupMpuSampleClock();
+#endif
+#ifdef MPU_BUS_BENCHMARK
+  benchmarkMpuReads();
+#endif
 
   // Connect to WiFi
   WiFi.begin(ssid, password);
+#ifndef OSC_TRANSPORT_SERIAL
   while (WiFi.status() != WL_CONNECTED) {
     digitalWrite(LED_BUILTIN, HIGH);
     delay(500);
     digitalWrite(LED_BUILTIN, LOW);
     delay(500);
-    Serial.println("Connecting to WiFi...");
+    logOut.println("Connecting to WiFi...");
+  }
+  logOut.println("WiFi connected");
+  logOut.print("ESP32 IP address: ");
+  logOut.println(WiFi.localIP());
+#endif
+  // Serial builds stream right away; the web server and clock sync come up whenever WiFi associates
+  if (!OSCDestinations::resolve(oscServerIp, oscServerAddress)) {
+    logOut.println("Could not resolve OSC server " + oscServerIp);
   }
-  Serial.println("WiFi connected");
-  Serial.print("ESP32 IP address: ");
-  Serial.println(WiFi.localIP());
+#ifdef OSC_CLOCK_SYNC
+  // Bound so replies (/sync/pong) find their way back to this socket
+  Udp.begin(OSC_LOCAL_PORT);
+#endif
+  destinations.add(oscServerAddress, oscServerPort1);
+  destinations.add(oscServerAddress, oscServerPort2);
+  setOutputMode(oscOutputMode);
+  xTaskCreatePinnedToCore(networkTask, "osc_tx", 4096, NULL, 2, &networkTaskHandle, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(samplingTask, "sampler", 4096, NULL, 3, NULL, SAMPLING_TASK_CORE);
   // Start web server
   server.on("/", handleRoot);
   server.on("/setip", HTTP_POST, handleSetIp);
+  server.on("/adddest", HTTP_POST, handleAddDestination);
+  server.on("/deldest", HTTP_POST, handleRemoveDestination);
+  server.on("/setmode", HTTP_POST, handleSetMode);
+  server.on("/stats", handleStats);
+  server.on("/setrate", HTTP_POST, handleSetRate);
+  server.on("/calibrate", HTTP_POST, handleCalibrate);
+#ifdef OSC_DEADBAND
+  server.on("/setdeadband", HTTP_POST, handleSetDeadBand);
+#endif
   server.begin();
-  Serial.println("Web server started on port 80");
-}
-
-void sendOSCMessages(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz) {
-  // Publish accelerometer data
-  acc.add((float)ax);
-  acc.add((float)ay);
-  acc.add((float)az);
-
-  // Publish gyroscope data
-  gyr.add((float)gx);
-  gyr.add((float)gy);
-  gyr.add((float)gz);
-
-  // Send to first port
-  Udp1.beginPacket(oscServerIp.c_str(), oscServerPort1);
-  acc.send(Udp1);
-  Udp1.endPacket();
-  acc.empty();
-
-  Udp1.beginPacket(oscServerIp.c_str(), oscServerPort1);
-  gyr.send(Udp1);
-  Udp1.endPacket();
-  gyr.empty();
-
-  // Send to second port
-  Udp2.beginPacket(oscServerIp.c_str(), oscServerPort2);
-  acc.send(Udp2);
-  Udp2.endPacket();
-  acc.empty();
-
-  Udp2.beginPacket(oscServerIp.c_str(), oscServerPort2);
-  gyr.send(Udp2);
-  Udp2.endPacket();
-  gyr.empty();
+  logOut.println("Web server started on port 80");
 }
 
 void loop() {
@@ -142,20 +997,12 @@ void loop() {
     if (now - lastButtonPress > debounceDelay) {
       buttonCounter++;
       if (buttonCounter > 5) buttonCounter = 1;
-      sendOptOSC(buttonCounter);
+      queueOptOSC(buttonCounter);
       lastButtonPress = now;
     }
   }
   lastButtonState = buttonState;
-  // Get accelerometer and gyroscope data
-  int16_t ax, ay, az;
-  int16_t gx, gy, gz;
-  mpu.getAcceleration(&ax, &ay, &az);
-  mpu.getRotation(&gx, &gy, &gz);
-
-  // Send OSC messages
-  sendOSCMessages(ax, ay, az, gx, gy, gz);
 
-  // Delay before next reading
-  delay(150);
+  // Sampling is paced by its own task; loop() only polls the web server and button
+  delay(5);
 }
\ No newline at end of file
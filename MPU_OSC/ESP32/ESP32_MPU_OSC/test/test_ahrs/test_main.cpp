@@ -0,0 +1,214 @@
+/**
+ * The float and Q30 Mahony filters against a simulated tumbling sensor, and
+ * the cost of one update of each.
+ */
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "Ahrs.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+
+static unsigned long micros() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+#define RATE_HZ 100
+#define PERIOD_US (1000000 / RATE_HZ)
+#define SIM_SECONDS 20
+#define SETTLE_SECONDS 2
+#define TRACE_SAMPLES 256
+
+static const float gyroScale = 250 * (float)(M_PI / 180) / 32768; // +-250 deg/s
+static int16_t trace[TRACE_SAMPLES][6];
+static uint32_t rngState;
+
+static int noise(int amplitude) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return (int)(rngState % (2 * amplitude + 1)) - amplitude;
+}
+
+// Angle in degrees between two orientations: 2 acos |q1 . q2|
+static float angleBetween(const float a[4], const float b[4]) {
+  float dot = fabsf(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+  return 2 * acosf(fminf(dot, 1)) * (180 / (float)M_PI);
+}
+
+struct SimResult {
+  float rmsError;      // float filter against the truth
+  float maxError;
+  float maxFixedError; // Q30 filter against the truth
+  float maxDiff;       // Q30 against float
+};
+
+/**
+ * 20 s of tumbling at 100 Hz: a different sine rate on each axis, +-2 g and
+ * +-250 deg/s counts with a little noise on every axis. Both filters run on
+ * the same samples and are scored after a 2 s settling time; the first
+ * samples are kept in trace for the timing test.
+ */
+static SimResult simulate() {
+  const float dt = 1.0f / RATE_HZ;
+  MahonyAhrs reference;
+  MahonyAhrsQ30 fixed;
+  reference.begin(gyroScale, PERIOD_US);
+  fixed.begin(gyroScale, PERIOD_US);
+  float truth[4] = {1, 0, 0, 0};
+  float sumSq = 0;
+  int counted = 0;
+  SimResult result = {0, 0, 0, 0};
+  for (uint32_t i = 0; i < SIM_SECONDS * RATE_HZ; i++) {
+    float t = i * dt;
+    float w[3] = {1.2f * sinf(0.7f * t), 0.9f * sinf(1.1f * t + 1), 0.6f * sinf(0.5f * t + 2)};
+    // truth = truth * exp(w dt / 2)
+    float angle = sqrtf(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]) * dt / 2;
+    float k = angle > 0 ? sinf(angle) / angle * dt / 2 : 0;
+    float d[4] = {cosf(angle), w[0] * k, w[1] * k, w[2] * k};
+    float q[4] = {
+      truth[0] * d[0] - truth[1] * d[1] - truth[2] * d[2] - truth[3] * d[3],
+      truth[0] * d[1] + truth[1] * d[0] + truth[2] * d[3] - truth[3] * d[2],
+      truth[0] * d[2] - truth[1] * d[3] + truth[2] * d[0] + truth[3] * d[1],
+      truth[0] * d[3] + truth[1] * d[2] - truth[2] * d[1] + truth[3] * d[0]
+    };
+    memcpy(truth, q, sizeof(truth));
+    int16_t s[6] = {
+      (int16_t)lroundf(2 * (q[1] * q[3] - q[0] * q[2]) * 16384 + noise(20)),
+      (int16_t)lroundf(2 * (q[0] * q[1] + q[2] * q[3]) * 16384 + noise(20)),
+      (int16_t)lroundf((q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]) * 16384 + noise(20)),
+      (int16_t)lroundf(w[0] / gyroScale + noise(5)),
+      (int16_t)lroundf(w[1] / gyroScale + noise(5)),
+      (int16_t)lroundf(w[2] / gyroScale + noise(5))
+    };
+    if (i < TRACE_SAMPLES) memcpy(trace[i], s, sizeof(s));
+    reference.update(s[0], s[1], s[2], s[3], s[4], s[5]);
+    fixed.update(s[0], s[1], s[2], s[3], s[4], s[5]);
+    if (t < SETTLE_SECONDS) continue;
+    float r[4], f[4];
+    reference.getQuaternion(r);
+    fixed.getQuaternion(f);
+    float error = angleBetween(r, q);
+    sumSq += error * error;
+    counted++;
+    result.maxError = fmaxf(result.maxError, error);
+    result.maxFixedError = fmaxf(result.maxFixedError, angleBetween(f, q));
+    result.maxDiff = fmaxf(result.maxDiff, angleBetween(f, r));
+  }
+  result.rmsError = sqrtf(sumSq / counted);
+  return result;
+}
+
+// Average time of one update over a few passes of the trace, in ns
+template <typename Filter>
+static unsigned long nsPerUpdate(Filter& filter) {
+  const int passes = 64;
+  unsigned long start = micros();
+  for (int p = 0; p < passes; p++) {
+    for (int i = 0; i < TRACE_SAMPLES; i++) {
+      filter.update(trace[i][0], trace[i][1], trace[i][2], trace[i][3], trace[i][4], trace[i][5]);
+    }
+  }
+  return (unsigned long)((uint64_t)(micros() - start) * 1000 / (passes * TRACE_SAMPLES));
+}
+
+void setUp() {
+  rngState = 2463534242UL;
+}
+
+void tearDown() {}
+
+void test_follows_a_tumbling_sensor() {
+  SimResult r = simulate();
+  char line[128];
+  snprintf(line, sizeof(line), "float rms %.2f max %.2f deg, Q30 max %.2f deg (%.3f from float)",
+           r.rmsError, r.maxError, r.maxFixedError, r.maxDiff);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN_FLOAT(2, r.rmsError);
+  TEST_ASSERT_LESS_THAN_FLOAT(5, r.maxError);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.5f, r.maxDiff);
+}
+
+void test_level_and_still_stays_level() {
+  MahonyAhrs reference;
+  MahonyAhrsQ30 fixed;
+  reference.begin(gyroScale, PERIOD_US);
+  fixed.begin(gyroScale, PERIOD_US);
+  for (int i = 0; i < 10 * RATE_HZ; i++) {
+    reference.update(0, 0, 16384, 0, 0, 0);
+    fixed.update(0, 0, 16384, 0, 0, 0);
+  }
+  const float identity[4] = {1, 0, 0, 0};
+  float q[4];
+  reference.getQuaternion(q);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.01f, angleBetween(q, identity));
+  fixed.getQuaternion(q);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.01f, angleBetween(q, identity));
+}
+
+void test_converges_to_gravity() {
+  // Rolled 90 degrees: gravity along +Y
+  MahonyAhrs reference;
+  MahonyAhrsQ30 fixed;
+  reference.begin(gyroScale, PERIOD_US);
+  fixed.begin(gyroScale, PERIOD_US);
+  for (int i = 0; i < 20 * RATE_HZ; i++) {
+    reference.update(0, 16384, 0, 0, 0, 0);
+    fixed.update(0, 16384, 0, 0, 0, 0);
+  }
+  float q[4], ypr[3];
+  reference.getQuaternion(q);
+  quatToYawPitchRoll(q, ypr);
+  TEST_ASSERT_FLOAT_WITHIN(1, 90, ypr[2] * (180 / (float)M_PI));
+  fixed.getQuaternion(q);
+  quatToYawPitchRoll(q, ypr);
+  TEST_ASSERT_FLOAT_WITHIN(1, 90, ypr[2] * (180 / (float)M_PI));
+}
+
+void test_update_cost() {
+  simulate(); // fills the trace
+  MahonyAhrs reference;
+  MahonyAhrsQ30 fixed;
+  reference.begin(gyroScale, PERIOD_US);
+  fixed.begin(gyroScale, PERIOD_US);
+  unsigned long floatNs = nsPerUpdate(reference);
+  unsigned long fixedNs = nsPerUpdate(fixed);
+  char line[96];
+  snprintf(line, sizeof(line), "%lu ns/update float, %lu ns/update Q30", floatNs, fixedNs);
+  TEST_MESSAGE(line);
+  // Still unit quaternions after thousands of updates (and the results are used)
+  float r[4], f[4];
+  reference.getQuaternion(r);
+  fixed.getQuaternion(f);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1, r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1, f[0] * f[0] + f[1] * f[1] + f[2] * f[2] + f[3] * f[3]);
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_follows_a_tumbling_sensor);
+  RUN_TEST(test_level_and_still_stays_level);
+  RUN_TEST(test_converges_to_gravity);
+  RUN_TEST(test_update_cost);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  runTests();
+}
+
+void loop() {}
+#else
+int main() {
+  return runTests();
+}
+#endif
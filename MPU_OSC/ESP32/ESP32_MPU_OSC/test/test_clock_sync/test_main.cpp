@@ -0,0 +1,112 @@
+/**
+ * ClockSync against simulated ping/pong exchanges with a drifting host clock.
+ */
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+#include "ClockSync.h"
+
+static uint32_t rngState;
+
+// Deterministic on every platform, unlike random()
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+// Exponentially distributed queueing delay with the given mean
+static int64_t queueingUs(float meanUs) {
+  return (int64_t)(-meanUs * logf((nextRandom() % 10000 + 1) / 10000.0f));
+}
+
+void setUp() {
+  rngState = 2463534242UL;
+}
+
+void tearDown() {}
+
+/**
+ * Five minutes of pings against a host clock that runs 80 ppm fast, with 2 ms
+ * base delay plus exponential queueing each way (and an occasional 80 ms stall).
+ */
+void test_tracks_offset_and_drift() {
+  const double drift = 80e-6;
+  const int64_t hostStart = 1760000000000000LL;
+  ClockSync sync;
+  int64_t device = 5000000;
+  for (int i = 0; i < 300; i++, device += 1000000) {
+    int64_t up = 2000 + queueingUs(3000);
+    int64_t down = 2000 + queueingUs(3000);
+    if (nextRandom() % 20 == 0) up += 80000;
+    int64_t t1 = device;
+    int64_t t2 = hostStart + (device + up) + (int64_t)((device + up) * drift);
+    int64_t t3 = t2 + 200;
+    int64_t t4 = device + up + 200 + down;
+    TEST_ASSERT_TRUE(sync.addExchange(t1, t2, t3, t4));
+  }
+  TEST_ASSERT_TRUE(sync.synced());
+  int64_t expected = hostStart + device + (int64_t)(device * drift);
+  int64_t errorUs = sync.hostUs(device) - expected;
+  TEST_ASSERT_LESS_THAN(2000, llabs(errorUs));
+  TEST_ASSERT_FLOAT_WITHIN(20, drift * 1e6, sync.driftPpm());
+}
+
+void test_first_exchange_syncs() {
+  ClockSync sync;
+  TEST_ASSERT_FALSE(sync.synced());
+  // 1 ms each way, host 1000 s ahead
+  TEST_ASSERT_TRUE(sync.addExchange(0, 1000001000LL, 1000001000LL, 2000));
+  TEST_ASSERT_TRUE(sync.synced());
+  TEST_ASSERT_EQUAL_INT64(1000000000LL + 5000, sync.hostUs(5000));
+}
+
+void test_rejects_negative_round_trip() {
+  ClockSync sync;
+  TEST_ASSERT_FALSE(sync.addExchange(1000, 500, 400, 2000));
+  TEST_ASSERT_FALSE(sync.addExchange(1000, 500, 600, 1050));
+  TEST_ASSERT_FALSE(sync.synced());
+}
+
+void test_parses_pong() {
+  // /sync/pong ,hhh: t1 (device), t2, t3 (host)
+  uint8_t pong[CLOCK_SYNC_PONG_SIZE] = {'/', 's', 'y', 'n', 'c', '/', 'p', 'o', 'n', 'g', 0, 0,
+                                        ',', 'h', 'h', 'h', 0, 0, 0, 0};
+  const int64_t times[3] = {5000000, 1760000000000000LL, -2};
+  for (int t = 0; t < 3; t++) {
+    for (int i = 0; i < 8; i++) pong[20 + 8 * t + i] = (uint8_t)((uint64_t)times[t] >> (56 - 8 * i));
+  }
+  int64_t t1, t2, t3;
+  TEST_ASSERT_TRUE(ClockSync::parsePong(pong, sizeof(pong), t1, t2, t3));
+  TEST_ASSERT_EQUAL_INT64(times[0], t1);
+  TEST_ASSERT_EQUAL_INT64(times[1], t2);
+  TEST_ASSERT_EQUAL_INT64(times[2], t3);
+  TEST_ASSERT_FALSE(ClockSync::parsePong(pong, sizeof(pong) - 1, t1, t2, t3));
+  pong[1] = 'x';
+  TEST_ASSERT_FALSE(ClockSync::parsePong(pong, sizeof(pong), t1, t2, t3));
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tracks_offset_and_drift);
+  RUN_TEST(test_first_exchange_syncs);
+  RUN_TEST(test_rejects_negative_round_trip);
+  RUN_TEST(test_parses_pong);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  runTests();
+}
+
+void loop() {}
+#else
+int main() {
+  return runTests();
+}
+#endif
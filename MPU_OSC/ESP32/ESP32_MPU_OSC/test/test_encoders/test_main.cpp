@@ -0,0 +1,102 @@
+/**
+ * The same /acc message encoded many times through the CNMAT OSCMessage path
+ * (add + send + empty, as the firmware used to) and through a preencoded
+ * OSCFrame: both must produce the same bytes, and the cost of each is reported.
+ *
+ * OSCMessage needs the Arduino core, so this one runs on the board only:
+ * pio test -e esp32dev -f test_encoders
+ */
+#include <Arduino.h>
+#include <unity.h>
+#include <OSCMessage.h>
+#include "OSCFrame.h"
+
+#define ENCODE_ITERATIONS 10000
+
+// Swallows the encoded bytes so only the encoding itself is timed
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+// Keeps the last packet written, for comparing the two encoders
+class CapturePrint : public Print {
+public:
+  CapturePrint() : _size(0) {}
+  size_t write(uint8_t b) override {
+    if (_size < sizeof(_buf)) _buf[_size++] = b;
+    return 1;
+  }
+  const uint8_t* data() const { return _buf; }
+  size_t size() const { return _size; }
+
+private:
+  uint8_t _buf[64];
+  size_t _size;
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_same_bytes() {
+  CapturePrint captured;
+  OSCMessage msg("/acc");
+  msg.add(1.5f);
+  msg.add(-2.0f);
+  msg.add(16384.0f);
+  msg.send(captured);
+
+  OSCFrame frame;
+  frame.begin();
+  int slot = frame.addMessage("/acc", "fff");
+  frame.setFloat(slot + 0, 1.5f);
+  frame.setFloat(slot + 1, -2.0f);
+  frame.setFloat(slot + 2, 16384.0f);
+
+  TEST_ASSERT_EQUAL_size_t(frame.size(), captured.size());
+  TEST_ASSERT_EQUAL_MEMORY(frame.data(), captured.data(), frame.size());
+}
+
+void test_encoding_cost() {
+  NullPrint sink;
+  OSCMessage msg("/acc");
+  OSCFrame frame;
+  frame.begin();
+  int slot = frame.addMessage("/acc", "fff");
+
+  unsigned long start = micros();
+  for (int i = 0; i < ENCODE_ITERATIONS; i++) {
+    msg.add((float)i);
+    msg.add((float)-i);
+    msg.add((float)(i * 2));
+    msg.send(sink);
+    msg.empty();
+  }
+  unsigned long oscMessageUs = micros() - start;
+
+  start = micros();
+  for (int i = 0; i < ENCODE_ITERATIONS; i++) {
+    frame.setFloat(slot + 0, i);
+    frame.setFloat(slot + 1, -i);
+    frame.setFloat(slot + 2, i * 2);
+    sink.write(frame.data(), frame.size());
+  }
+  unsigned long oscFrameUs = micros() - start;
+
+  char line[96];
+  snprintf(line, sizeof(line), "OSCMessage: %lu ns/msg, OSCFrame: %lu ns/msg",
+           oscMessageUs * 1000UL / ENCODE_ITERATIONS, oscFrameUs * 1000UL / ENCODE_ITERATIONS);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(oscMessageUs, oscFrameUs);
+}
+
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  UNITY_BEGIN();
+  RUN_TEST(test_same_bytes);
+  RUN_TEST(test_encoding_cost);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,283 @@
+/**
+ * OSCFrame layouts, LoopbackTransport, and the firmware's sample encoders
+ * (SampleEncoder.h) sending through it.
+ *
+ * Host-portable: pio test -e native (or -e esp32dev on the board).
+ */
+#include <unity.h>
+#include "OSCFrame.h"
+#include "OSCTransport.h"
+#include "SampleEncoder.h"
+
+static uint32_t be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t le16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static ImuSample makeSample(uint32_t seq, int64_t timestampUs, const int16_t axes[6]) {
+  ImuSample sample;
+  sample.timestampUs = timestampUs;
+  sample.seq = seq;
+  sample.ax = axes[0];
+  sample.ay = axes[1];
+  sample.az = axes[2];
+  sample.gx = axes[3];
+  sample.gy = axes[4];
+  sample.gz = axes[5];
+  return sample;
+}
+
+static float beFloat(const uint8_t* p) {
+  uint32_t bits = be32(p);
+  float value;
+  memcpy(&value, &bits, 4);
+  return value;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_message_layout() {
+  OSCFrame frame;
+  frame.begin();
+  int slot = frame.addMessage("/acc", "fffih");
+  TEST_ASSERT_EQUAL_INT(0, slot);
+  TEST_ASSERT_TRUE(frame.ok());
+  // Padded address and type tags, then 3 floats, an int and an int64
+  TEST_ASSERT_EQUAL_size_t(8 + 8 + 3 * 4 + 4 + 8, frame.size());
+  TEST_ASSERT_EQUAL_MEMORY("/acc\0\0\0\0,fffih\0\0", frame.data(), 16);
+
+  frame.setFloat(slot + 0, 1.0f);
+  frame.setFloat(slot + 2, -2.5f);
+  frame.setInt(slot + 3, -2);
+  frame.setInt64(slot + 4, 0x0102030405060708LL);
+  const uint8_t* args = frame.data() + 16;
+  TEST_ASSERT_EQUAL_UINT32(0x3F800000, be32(args));
+  TEST_ASSERT_EQUAL_UINT32(0xC0200000, be32(args + 8));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFE, be32(args + 12));
+  TEST_ASSERT_EQUAL_UINT32(0x01020304, be32(args + 16));
+  TEST_ASSERT_EQUAL_UINT32(0x05060708, be32(args + 20));
+}
+
+void test_bundle_layout() {
+  OSCFrame frame;
+  frame.begin(true);
+  TEST_ASSERT_EQUAL_size_t(16, frame.size());
+  TEST_ASSERT_EQUAL_MEMORY("#bundle\0\0\0\0\0\0\0\0\x01", frame.data(), 16);
+  int acc = frame.addMessage("/acc", "fffih");
+  int gyr = frame.addMessage("/gyr", "fffih");
+  TEST_ASSERT_EQUAL_INT(0, acc);
+  TEST_ASSERT_EQUAL_INT(5, gyr);
+  TEST_ASSERT_EQUAL_size_t(16 + 2 * (4 + 40), frame.size());
+  // Each element is prefixed with its size
+  TEST_ASSERT_EQUAL_UINT32(40, be32(frame.data() + 16));
+  TEST_ASSERT_EQUAL_MEMORY("/gyr", frame.data() + 16 + 44 + 4, 4);
+
+  frame.setTimetag(0x83AA7E80, 0x80000000);
+  TEST_ASSERT_EQUAL_UINT32(0x83AA7E80, be32(frame.data() + 8));
+  TEST_ASSERT_EQUAL_UINT32(0x80000000, be32(frame.data() + 12));
+}
+
+void test_plain_frame_holds_one_message() {
+  OSCFrame frame;
+  frame.begin();
+  TEST_ASSERT_EQUAL_INT(0, frame.addMessage("/acc", "fff"));
+  TEST_ASSERT_EQUAL_INT(-1, frame.addMessage("/gyr", "fff"));
+  TEST_ASSERT_FALSE(frame.ok());
+  // begin() starts over
+  frame.begin();
+  TEST_ASSERT_TRUE(frame.ok());
+}
+
+void test_rejects_what_does_not_fit() {
+  OSCFrame frame;
+  frame.begin(true);
+  TEST_ASSERT_EQUAL_INT(-1, frame.addMessage("/str", "s"));
+  TEST_ASSERT_FALSE(frame.ok());
+
+  char typetags[OSC_FRAME_MAX_SLOTS + 2];
+  memset(typetags, 'i', OSC_FRAME_MAX_SLOTS + 1);
+  typetags[OSC_FRAME_MAX_SLOTS + 1] = '\0';
+  frame.begin(true);
+  TEST_ASSERT_EQUAL_INT(-1, frame.addMessage("/many", typetags));
+
+  frame.begin(true);
+  TEST_ASSERT_EQUAL_INT(-1, frame.addMessage("/big", "b", OSC_FRAME_SIZE));
+  TEST_ASSERT_EQUAL_size_t(16, frame.size());
+}
+
+void test_blob_slot() {
+  OSCFrame frame;
+  frame.begin();
+  int slot = frame.addMessage("/imu", "hib", 18);
+  TEST_ASSERT_TRUE(frame.ok());
+  // "/imu" + ",hib", then h, i, the length word and 18 bytes padded to 20
+  TEST_ASSERT_EQUAL_size_t(8 + 8 + 8 + 4 + 4 + 20, frame.size());
+  const uint8_t* length = frame.data() + 28;
+  TEST_ASSERT_EQUAL_UINT32(18, be32(length));
+  uint8_t* payload = frame.blob(slot + 2);
+  TEST_ASSERT_TRUE(payload == length + 4);
+  payload[17] = 0xAB;
+  TEST_ASSERT_EQUAL_UINT8(0xAB, frame.data()[32 + 17]);
+}
+
+void test_loopback_keeps_the_last_packet() {
+  LoopbackTransport loopback;
+  OSCTransport& transport = loopback;
+  const uint8_t first[4] = {1, 2, 3, 4};
+  const uint8_t second[8] = {5, 6, 7, 8, 9, 10, 11, 12};
+  TEST_ASSERT_EQUAL_INT(1, transport.send(first, sizeof(first)));
+  TEST_ASSERT_EQUAL_INT(1, transport.send(second, sizeof(second)));
+  TEST_ASSERT_EQUAL_STRING("loopback", transport.name());
+  TEST_ASSERT_EQUAL_UINT32(2, loopback.packets());
+  TEST_ASSERT_EQUAL_UINT32(12, (uint32_t)loopback.bytes());
+  TEST_ASSERT_EQUAL_size_t(sizeof(second), loopback.size());
+  TEST_ASSERT_EQUAL_MEMORY(second, loopback.data(), sizeof(second));
+  TEST_ASSERT_EQUAL_UINT32(0, loopback.truncated());
+
+  loopback.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, loopback.packets());
+  TEST_ASSERT_EQUAL_size_t(0, loopback.size());
+}
+
+void test_loopback_truncates_oversized_packets() {
+  static uint8_t big[LOOPBACK_TRANSPORT_SIZE + 100];
+  for (size_t i = 0; i < sizeof(big); i++) big[i] = (uint8_t)i;
+  LoopbackTransport loopback;
+  loopback.send(big, sizeof(big));
+  TEST_ASSERT_EQUAL_UINT32(1, loopback.truncated());
+  TEST_ASSERT_EQUAL_size_t(LOOPBACK_TRANSPORT_SIZE, loopback.size());
+  TEST_ASSERT_EQUAL_MEMORY(big, loopback.data(), LOOPBACK_TRANSPORT_SIZE);
+}
+
+// The bundle mode sample packet: /acc and /gyr of one sample under one timetag
+void test_sample_bundle_through_transport() {
+  SampleEncoder encoder;
+  encoder.begin(true);
+  LoopbackTransport loopback;
+  OSCTransport* transport = &loopback;
+
+  const int16_t axes[6] = {100, -200, 16384, -32768, 32767, 5};
+  const int64_t timestampUs = 123456789012LL;
+  uint32_t packetSeq = 0;
+  for (uint32_t n = 1; n <= 3; n++) {
+    encoder.send(*transport, makeSample(n, timestampUs, axes), packetSeq, (uint64_t)(0x83AA7E80 + n) << 32);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(3, packetSeq);
+  TEST_ASSERT_EQUAL_UINT32(3, loopback.packets());
+  TEST_ASSERT_EQUAL_size_t(16 + 2 * (4 + 40), loopback.size());
+  const uint8_t* p = loopback.data();
+  TEST_ASSERT_EQUAL_UINT32(0x83AA7E83, be32(p + 8));
+  const uint8_t* acc = p + 16 + 4 + 16; // size word, address, type tags
+  const uint8_t* gyr = acc + 24 + 4 + 16;
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_FLOAT(axes[i], beFloat(acc + 4 * i));
+    TEST_ASSERT_EQUAL_FLOAT(axes[3 + i], beFloat(gyr + 4 * i));
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, be32(acc + 12));
+  TEST_ASSERT_EQUAL_UINT32(3, be32(gyr + 12));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)(timestampUs >> 32), be32(gyr + 16));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)timestampUs, be32(gyr + 20));
+}
+
+// Without bundles /acc and /gyr are two datagrams, each with its own sequence number
+void test_sample_messages_number_each_datagram() {
+  SampleEncoder encoder;
+  encoder.begin(false);
+  LoopbackTransport loopback;
+  const int16_t axes[6] = {1, 2, 3, 4, 5, 6};
+  uint32_t packetSeq = 10;
+  encoder.send(loopback, makeSample(1, 1000, axes), packetSeq, 0);
+  TEST_ASSERT_EQUAL_UINT32(12, packetSeq);
+  TEST_ASSERT_EQUAL_UINT32(2, loopback.packets());
+  TEST_ASSERT_EQUAL_MEMORY("/gyr", loopback.data(), 4);
+  TEST_ASSERT_EQUAL_UINT32(12, be32(loopback.data() + 16 + 12));
+}
+
+void test_ntp_timetag() {
+  // 1.5 s after the epoch
+  uint64_t t = ntpTimetag(1500000, 0x83AA7E80);
+  TEST_ASSERT_EQUAL_UINT32(0x83AA7E81, (uint32_t)(t >> 32));
+  TEST_ASSERT_EQUAL_UINT32(0x80000000, (uint32_t)t);
+}
+
+void test_batch_layout() {
+  BatchEncoder encoder;
+  TEST_ASSERT_TRUE(encoder.begin(false, 2));
+  LoopbackTransport loopback;
+  const int16_t first[6] = {1, 2, 3, 4, 5, 6};
+  const int16_t second[6] = {-1, -2, -3, -4, -5, -6};
+  ImuSample samples[2] = {makeSample(7, 5000, first), makeSample(8, 15000, second)};
+  uint32_t packetSeq = 0;
+  encoder.send(loopback, samples, 2, 10000, packetSeq, 0);
+  // "/batch" and ",hii" + 12 f, then h, i, i and 12 floats
+  TEST_ASSERT_EQUAL_size_t(8 + 20 + 8 + 4 + 4 + 12 * 4, loopback.size());
+  const uint8_t* args = loopback.data() + 28;
+  TEST_ASSERT_EQUAL_UINT32(5000, be32(args + 4));
+  TEST_ASSERT_EQUAL_UINT32(10000, be32(args + 8));
+  TEST_ASSERT_EQUAL_UINT32(1, be32(args + 12));
+  TEST_ASSERT_EQUAL_FLOAT(1, beFloat(args + 16));
+  TEST_ASSERT_EQUAL_FLOAT(-6, beFloat(args + 16 + 11 * 4));
+
+  // A short batch relays the frame out for fewer samples
+  encoder.send(loopback, samples, 1, 10000, packetSeq, 0);
+  TEST_ASSERT_EQUAL_size_t(8 + 12 + 8 + 4 + 4 + 6 * 4, loopback.size());
+  TEST_ASSERT_EQUAL_UINT32(2, packetSeq);
+}
+
+void test_imu_blob_layout() {
+  ImuBlobEncoder encoder;
+  TEST_ASSERT_TRUE(encoder.begin(false, 2));
+  LoopbackTransport loopback;
+  const int16_t first[6] = {1, 2, 3, 4, 5, 6};
+  const int16_t second[6] = {-1, -2, -3, -4, -5, -32768};
+  ImuSample samples[2] = {makeSample(0x00012345, 5000, first), makeSample(0x00012346, 15000, second)};
+  uint32_t packetSeq = 0;
+  encoder.send(loopback, samples, 2, 10000, packetSeq, 0);
+  // "/imu" + ",hib", h, i, the length word, then the 8-byte header and 2 x 12 bytes
+  TEST_ASSERT_EQUAL_size_t(8 + 8 + 8 + 4 + 4 + IMU_BLOB_HEADER + 2 * IMU_BLOB_SAMPLE, loopback.size());
+  const uint8_t* blob = loopback.data() + 32;
+  TEST_ASSERT_EQUAL_UINT32(IMU_BLOB_HEADER + 2 * IMU_BLOB_SAMPLE, be32(blob - 4));
+  TEST_ASSERT_EQUAL_UINT16(0x2345, le16(blob));
+  TEST_ASSERT_EQUAL_UINT16(0x0001, le16(blob + 2));
+  TEST_ASSERT_EQUAL_UINT16(2, le16(blob + 4));
+  TEST_ASSERT_EQUAL_UINT16(10000, le16(blob + 6));
+  TEST_ASSERT_EQUAL_INT16(1, (int16_t)le16(blob + IMU_BLOB_HEADER));
+  TEST_ASSERT_EQUAL_INT16(-32768, (int16_t)le16(blob + IMU_BLOB_HEADER + IMU_BLOB_SAMPLE + 10));
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_message_layout);
+  RUN_TEST(test_bundle_layout);
+  RUN_TEST(test_plain_frame_holds_one_message);
+  RUN_TEST(test_rejects_what_does_not_fit);
+  RUN_TEST(test_blob_slot);
+  RUN_TEST(test_loopback_keeps_the_last_packet);
+  RUN_TEST(test_loopback_truncates_oversized_packets);
+  RUN_TEST(test_sample_bundle_through_transport);
+  RUN_TEST(test_sample_messages_number_each_datagram);
+  RUN_TEST(test_ntp_timetag);
+  RUN_TEST(test_batch_layout);
+  RUN_TEST(test_imu_blob_layout);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  runTests();
+}
+
+void loop() {}
+#else
+int main() {
+  return runTests();
+}
+#endif
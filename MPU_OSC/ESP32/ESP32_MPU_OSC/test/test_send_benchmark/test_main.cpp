@@ -0,0 +1,130 @@
+/**
+ * Encode + send throughput of the sample wire formats into a LoopbackTransport:
+ * the firmware's own encoders (SampleEncoder.h) minus the radio, so the cost
+ * per sample is reproducible on the host (pio test -e native) as well as on
+ * the board (pio test -e esp32dev).
+ */
+#include <unity.h>
+#include <stdio.h>
+// Sized like the firmware's, so a /batch of 10 fits
+#define OSC_FRAME_SIZE 1400
+#define OSC_FRAME_MAX_SLOTS 200
+#include "OSCFrame.h"
+#include "OSCTransport.h"
+#include "SampleEncoder.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define BENCH_SAMPLES 100000UL
+#else
+#include <chrono>
+#define BENCH_SAMPLES 1000000UL
+
+static unsigned long micros() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+#define BENCH_BATCH 10
+#define BENCH_INTERVAL_US 10000
+
+static ImuSample samples[BENCH_BATCH];
+static LoopbackTransport loopback;
+static OSCTransport* transport = &loopback;
+
+// Large steps on every axis, as a moving sensor gives
+static void fillSamples(uint32_t first) {
+  for (int i = 0; i < BENCH_BATCH; i++) {
+    int16_t v = (int16_t)((first + i) * 1000);
+    samples[i].timestampUs = (int64_t)(first + i) * BENCH_INTERVAL_US;
+    samples[i].seq = first + i;
+    samples[i].ax = v;
+    samples[i].ay = -v;
+    samples[i].az = v / 2;
+    samples[i].gx = -v / 2;
+    samples[i].gy = v / 3;
+    samples[i].gz = -v / 3;
+  }
+}
+
+static void report(const char* format, unsigned long elapsedUs) {
+  char line[160];
+  snprintf(line, sizeof(line), "%s: %lu ns/sample, %lu bytes/sample, %lu packets",
+           format, (unsigned long)((uint64_t)elapsedUs * 1000 / BENCH_SAMPLES),
+           (unsigned long)(loopback.bytes() / BENCH_SAMPLES), (unsigned long)loopback.packets());
+  TEST_MESSAGE(line);
+  TEST_ASSERT_EQUAL_UINT32(0, loopback.truncated());
+}
+
+void setUp() {
+  loopback.reset();
+}
+
+void tearDown() {}
+
+// OSC_BUNDLE_MODE, OSC_BATCH_SIZE 1: /acc and /gyr in one bundle per sample
+void test_bundle_per_sample() {
+  static SampleEncoder encoder;
+  encoder.begin(true);
+  uint32_t packetSeq = 0;
+  unsigned long start = micros();
+  for (uint32_t n = 0; n < BENCH_SAMPLES; n += BENCH_BATCH) {
+    fillSamples(n);
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      encoder.send(*transport, samples[i], packetSeq, ntpTimetag(samples[i].timestampUs, 0));
+    }
+  }
+  report("bundle /acc+/gyr", micros() - start);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_SAMPLES, loopback.packets());
+}
+
+// OSC_BATCH_SIZE 10: one /batch message of floats per 10 samples
+void test_batch() {
+  static BatchEncoder encoder;
+  TEST_ASSERT_TRUE(encoder.begin(true, BENCH_BATCH));
+  uint32_t packetSeq = 0;
+  unsigned long start = micros();
+  for (uint32_t n = 0; n < BENCH_SAMPLES; n += BENCH_BATCH) {
+    fillSamples(n);
+    encoder.send(*transport, samples, BENCH_BATCH, BENCH_INTERVAL_US, packetSeq, ntpTimetag(samples[0].timestampUs, 0));
+  }
+  report("/batch x10", micros() - start);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_SAMPLES / BENCH_BATCH, loopback.packets());
+}
+
+// OSC_IMU_BLOB: packed int16 axes, 12 bytes per sample
+void test_imu_blob() {
+  static ImuBlobEncoder encoder;
+  TEST_ASSERT_TRUE(encoder.begin(true, BENCH_BATCH));
+  uint32_t packetSeq = 0;
+  unsigned long start = micros();
+  for (uint32_t n = 0; n < BENCH_SAMPLES; n += BENCH_BATCH) {
+    fillSamples(n);
+    encoder.send(*transport, samples, BENCH_BATCH, BENCH_INTERVAL_US, packetSeq, ntpTimetag(samples[0].timestampUs, 0));
+  }
+  report("/imu blob x10", micros() - start);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_SAMPLES / BENCH_BATCH, loopback.packets());
+}
+
+int runTests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bundle_per_sample);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_imu_blob);
+  return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+  delay(2000); // lets the test runner open the serial port
+  runTests();
+}
+
+void loop() {}
+#else
+int main() {
+  return runTests();
+}
+#endif
@@ -0,0 +1,174 @@
+/**
+ * Fixed-rate sampling clock driven by a periodic esp_timer or by the sensor's
+ * data-ready interrupt.
+ *
+ * The timer callback (or the pin ISR) only wakes the sampling task, which
+ * blocks in wait() between ticks, so the sample rate no longer depends on how
+ * long sending, LEDs or delay() took. wait() returns the microsecond timestamp
+ * of the sample and keeps interval/jitter statistics against the nominal period.
+ *
+ * With beginInterrupt() the sensor's own sample clock paces the task, so each
+ * wakeup finds exactly one new sample: no duplicates from reading early, no
+ * samples lost to the two clocks drifting apart. The timestamp is taken in
+ * the ISR, at the data-ready edge. If no edge comes within
+ * SAMPLER_EDGE_TIMEOUT_PERIODS periods (INT not wired, sensor reset), wait()
+ * returns anyway and keeps pacing the task at the nominal period until the
+ * edges come back, so a missing interrupt slows sampling down instead of
+ * stopping it.
+ */
+#ifndef FIXED_RATE_SAMPLER_H
+#define FIXED_RATE_SAMPLER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <math.h>
+
+#define SAMPLER_MIN_RATE_HZ 50
+#define SAMPLER_MAX_RATE_HZ 1000
+#define SAMPLER_EDGE_TIMEOUT_PERIODS 3 // data-ready edges missed before wait() stops waiting for them
+
+struct SamplerJitterStats {
+  uint32_t samples;
+  uint32_t missedTicks;   // ticks that fired while the task was still busy
+  uint32_t edgeTimeouts;  // interrupt mode: waits that ended without a data-ready edge
+  uint32_t periodUs;      // nominal period
+  float meanIntervalUs;
+  float stddevUs;
+  uint32_t maxDeviationUs; // largest |interval - period|
+};
+
+class FixedRateSampler {
+public:
+  FixedRateSampler() : _timer(NULL), _task(NULL), _rateHz(0), _lastUs(0), _edgeUs(0),
+                       _interrupt(false), _edgeLost(false) {
+    resetStats();
+  }
+
+  /**
+   * @brief Starts ticking at rateHz (clamped to 50..1000 Hz), waking the calling task.
+   */
+  bool begin(uint32_t rateHz) {
+    _task = xTaskGetCurrentTaskHandle();
+    esp_timer_create_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.callback = &FixedRateSampler::onTick;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "sampler";
+    if (esp_timer_create(&args, &_timer) != ESP_OK) return false;
+    return setRate(rateHz);
+  }
+
+  /**
+   * @brief Wakes the calling task on each rising edge of a sensor's data-ready pin instead of a timer.
+   *
+   * @param rateHz The rate the sensor was programmed to, for the jitter statistics.
+   */
+  bool beginInterrupt(uint8_t pin, uint32_t rateHz) {
+    _task = xTaskGetCurrentTaskHandle();
+    _interrupt = true;
+    setRate(rateHz);
+    pinMode(pin, INPUT);
+    attachInterruptArg(digitalPinToInterrupt(pin), &FixedRateSampler::onDataReady, this, RISING);
+    return true;
+  }
+
+  /**
+   * @brief Changes the rate on the fly; also restarts the jitter statistics.
+   *
+   * In interrupt mode the caller reprograms the sensor and this only records
+   * the new nominal rate.
+   */
+  bool setRate(uint32_t rateHz) {
+    if (rateHz < SAMPLER_MIN_RATE_HZ) rateHz = SAMPLER_MIN_RATE_HZ;
+    if (rateHz > SAMPLER_MAX_RATE_HZ) rateHz = SAMPLER_MAX_RATE_HZ;
+    _rateHz = rateHz;
+    resetStats();
+    if (_timer == NULL) return true;
+    esp_timer_stop(_timer); // fails harmlessly if not running yet
+    return esp_timer_start_periodic(_timer, periodUs()) == ESP_OK;
+  }
+
+  /**
+   * @brief Blocks until the next tick.
+   *
+   * In interrupt mode the wait is bounded: see SAMPLER_EDGE_TIMEOUT_PERIODS.
+   *
+   * @return The sample timestamp in microseconds since boot.
+   */
+  int64_t wait() {
+    if (!_interrupt) return record(ulTaskNotifyTake(pdTRUE, portMAX_DELAY), esp_timer_get_time());
+    // Once an edge was missed, one period at a time until they come back
+    uint32_t periods = _edgeLost ? 1 : SAMPLER_EDGE_TIMEOUT_PERIODS;
+    TickType_t timeout = pdMS_TO_TICKS(periods * periodUs() / 1000);
+    uint32_t ticks = ulTaskNotifyTake(pdTRUE, timeout > 0 ? timeout : 1);
+    _edgeLost = ticks == 0;
+    if (_edgeLost) {
+      _stats.edgeTimeouts++;
+      return record(1, esp_timer_get_time());
+    }
+    return record(ticks, _edgeUs);
+  }
+
+  uint32_t rate() const { return _rateHz; }
+  uint32_t periodUs() const { return _rateHz ? 1000000UL / _rateHz : 0; }
+
+  SamplerJitterStats stats() const {
+    SamplerJitterStats s = _stats;
+    s.periodUs = periodUs();
+    s.meanIntervalUs = _mean;
+    s.stddevUs = _stats.samples > 1 ? sqrtf(_m2 / (_stats.samples - 1)) : 0;
+    return s;
+  }
+
+  void resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+    _mean = 0;
+    _m2 = 0;
+    _lastUs = 0;
+  }
+
+private:
+  static void onTick(void* arg) {
+    FixedRateSampler* self = static_cast<FixedRateSampler*>(arg);
+    xTaskNotifyGive(self->_task);
+  }
+
+  static void IRAM_ATTR onDataReady(void* arg) {
+    FixedRateSampler* self = static_cast<FixedRateSampler*>(arg);
+    self->_edgeUs = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(self->_task, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+
+  int64_t record(uint32_t ticks, int64_t now) {
+    if (ticks > 1) _stats.missedTicks += ticks - 1;
+    if (_lastUs != 0) addInterval((float)(now - _lastUs));
+    _lastUs = now;
+    return now;
+  }
+
+  // Welford running mean/variance of the sample intervals
+  void addInterval(float intervalUs) {
+    _stats.samples++;
+    float delta = intervalUs - _mean;
+    _mean += delta / _stats.samples;
+    _m2 += delta * (intervalUs - _mean);
+    float deviation = fabsf(intervalUs - (float)periodUs());
+    if (deviation > _stats.maxDeviationUs) _stats.maxDeviationUs = (uint32_t)deviation;
+  }
+
+  esp_timer_handle_t _timer;
+  TaskHandle_t _task;
+  uint32_t _rateHz;
+  int64_t _lastUs;
+  volatile int64_t _edgeUs; // set by the data-ready ISR
+  bool _interrupt;
+  bool _edgeLost; // the last wait timed out
+  SamplerJitterStats _stats;
+  float _mean;
+  float _m2;
+};
+
+#endif
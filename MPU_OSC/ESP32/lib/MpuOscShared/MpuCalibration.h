@@ -0,0 +1,209 @@
+/**
+ * Zero offsets for an MPU6050, measured once and kept in NVS.
+ *
+ * calibrate() averages the raw counts of a still period: the gyroscope should
+ * read 0 on every axis and the accelerometer 0, 0, +1 g (lying flat, Z up).
+ * The corrections go into the chip's own offset registers (XA_OFFS and
+ * XG_OFFS_USR), which the sensor applies before its data registers, the FIFO
+ * and the DMP see a sample, so they cost nothing per sample.
+ *
+ * Those registers are volatile and a device reset (begin(), initialize(), a
+ * DMP load) restores the factory values, so the result is stored with
+ * Preferences and load() writes it back at every boot.
+ *
+ * Nothing changes if the sensor moved during the average or is not lying flat
+ * with Z up, so it is only run on request, never on its own at boot.
+ */
+#ifndef MPU_CALIBRATION_H
+#define MPU_CALIBRATION_H
+
+#include <Preferences.h>
+#include "MpuRaw.h"
+
+#define MPU_CAL_REG_ACCEL_OFFS 0x06 // XA_OFFS_H..ZA_OFFS_L, 1/2048 g per LSB, bit 0 reserved
+#define MPU_CAL_REG_GYRO_OFFS 0x13  // XG_OFFS_USRH..ZG_OFFS_USRL, 1/32.768 deg/s per LSB
+#define MPU_CAL_ACCEL_LSB_PER_G 2048.0f
+#define MPU_CAL_GYRO_LSB_PER_RAD (32.768f * 180 / (float)M_PI)
+
+#ifndef MPU_CAL_SAMPLES
+#define MPU_CAL_SAMPLES 256 // averaged per pass
+#endif
+#define MPU_CAL_INTERVAL_MS 4
+#define MPU_CAL_SETTLE_MS 100 // new offsets through the low-pass filter before the next pass
+#define MPU_CAL_PASSES 2 // the second pass measures what the first one left
+#define MPU_CAL_MAX_GYRO_SPREAD 0.05f // rad/s (~3 deg/s) between extremes, or it moved
+#define MPU_CAL_MAX_ACCEL_SPREAD 0.1f // g
+#define MPU_CAL_MAX_TILT 0.15f // g off 0, 0, +1 on any axis, or it is not flat
+#define MPU_CAL_NAMESPACE "imu-cal"
+
+enum MpuCalibrationStatus {
+  MPU_CAL_NONE,      // factory offsets
+  MPU_CAL_LOADED,    // restored from NVS
+  MPU_CAL_DONE,      // measured this session
+  MPU_CAL_NOT_FLAT,  // the last attempt was not flat with Z up; the previous offsets stay
+  MPU_CAL_MOVED,     // the last attempt saw motion; the previous offsets stay
+  MPU_CAL_FAILED     // bus error
+};
+
+class MpuCalibration {
+public:
+  explicit MpuCalibration(MpuRaw& mpu) : _mpu(mpu), _status(MPU_CAL_NONE) {
+    snprintf(_key, sizeof(_key), "mpu%02x", mpu.address());
+  }
+
+  /**
+   * @brief Writes the stored offsets into the sensor.
+   *
+   * @return false if nothing is stored (or the bus failed); the sensor keeps its factory offsets.
+   */
+  bool load() {
+    Offsets offsets;
+    Preferences prefs;
+    prefs.begin(MPU_CAL_NAMESPACE, true);
+    bool found = prefs.getBytesLength(_key) == sizeof(offsets) &&
+                 prefs.getBytes(_key, &offsets, sizeof(offsets)) == sizeof(offsets);
+    prefs.end();
+    if (!found) return false;
+    if (!write(offsets)) {
+      _status = MPU_CAL_FAILED;
+      return false;
+    }
+    _status = MPU_CAL_LOADED;
+    return true;
+  }
+
+  /**
+   * @brief Measures new offsets while the sensor lies still, applies and stores them.
+   *
+   * Blocks for about MPU_CAL_PASSES * MPU_CAL_SAMPLES * MPU_CAL_INTERVAL_MS
+   * (2 s); the caller owns the bus meanwhile.
+   */
+  bool calibrate() {
+    Offsets before, offsets;
+    if (!read(before)) return fail(MPU_CAL_FAILED);
+    offsets = before;
+    for (int pass = 0; pass < MPU_CAL_PASSES; pass++) {
+      float accel[3], gyro[3];
+      MpuCalibrationStatus result = average(accel, gyro);
+      if (result != MPU_CAL_DONE) {
+        write(before);
+        return fail(result);
+      }
+      // Accelerometer in g, gyroscope in rad/s
+      for (int i = 0; i < 3; i++) {
+        accel[i] *= _mpu.accelScale() / MPU_RAW_STANDARD_GRAVITY;
+        gyro[i] *= _mpu.gyroScale();
+      }
+      accel[2] -= 1;
+      for (int i = 0; i < 3; i++) {
+        if (fabsf(accel[i]) > MPU_CAL_MAX_TILT) {
+          write(before);
+          return fail(MPU_CAL_NOT_FLAT);
+        }
+      }
+      for (int i = 0; i < 3; i++) {
+        offsets.gyro[i] -= (int16_t)lroundf(gyro[i] * MPU_CAL_GYRO_LSB_PER_RAD);
+        // Even steps only, so the reserved bit 0 keeps its factory value
+        int16_t step = (int16_t)(lroundf(accel[i] * MPU_CAL_ACCEL_LSB_PER_G / 2) * 2);
+        offsets.accel[i] -= step;
+      }
+      if (!write(offsets)) return fail(MPU_CAL_FAILED);
+      delay(MPU_CAL_SETTLE_MS);
+    }
+
+    Preferences prefs;
+    prefs.begin(MPU_CAL_NAMESPACE, false);
+    prefs.putBytes(_key, &offsets, sizeof(offsets));
+    prefs.end();
+    _status = MPU_CAL_DONE;
+    return true;
+  }
+
+  /**
+   * @brief Forgets the stored offsets; the factory ones come back at the next device reset.
+   */
+  void clear() {
+    Preferences prefs;
+    prefs.begin(MPU_CAL_NAMESPACE, false);
+    prefs.remove(_key);
+    prefs.end();
+    _status = MPU_CAL_NONE;
+  }
+
+  MpuCalibrationStatus status() const { return _status; }
+
+  const char* statusText() const {
+    switch (_status) {
+      case MPU_CAL_LOADED: return "loaded";
+      case MPU_CAL_DONE: return "calibrated";
+      case MPU_CAL_NOT_FLAT: return "not flat, not applied";
+      case MPU_CAL_MOVED: return "moved, not applied";
+      case MPU_CAL_FAILED: return "bus error";
+      default: return "none";
+    }
+  }
+
+private:
+  struct Offsets {
+    int16_t accel[3];
+    int16_t gyro[3];
+  };
+
+  bool fail(MpuCalibrationStatus status) {
+    _status = status;
+    return false;
+  }
+
+  // Mean raw counts over MPU_CAL_SAMPLES reads; MPU_CAL_MOVED if the spread says it was not still
+  MpuCalibrationStatus average(float accel[3], float gyro[3]) {
+    int32_t sum[6] = {0, 0, 0, 0, 0, 0};
+    int16_t low[6], high[6];
+    for (int n = 0; n < MPU_CAL_SAMPLES; n++) {
+      MpuRawSample s;
+      if (!_mpu.read(s)) return MPU_CAL_FAILED;
+      int16_t v[6] = {s.ax, s.ay, s.az, s.gx, s.gy, s.gz};
+      for (int i = 0; i < 6; i++) {
+        sum[i] += v[i];
+        if (n == 0 || v[i] < low[i]) low[i] = v[i];
+        if (n == 0 || v[i] > high[i]) high[i] = v[i];
+      }
+      delay(MPU_CAL_INTERVAL_MS);
+    }
+    for (int i = 0; i < 3; i++) {
+      if ((high[i] - low[i]) * _mpu.accelScale() / MPU_RAW_STANDARD_GRAVITY > MPU_CAL_MAX_ACCEL_SPREAD ||
+          (high[i + 3] - low[i + 3]) * _mpu.gyroScale() > MPU_CAL_MAX_GYRO_SPREAD) {
+        return MPU_CAL_MOVED;
+      }
+      accel[i] = (float)sum[i] / MPU_CAL_SAMPLES;
+      gyro[i] = (float)sum[i + 3] / MPU_CAL_SAMPLES;
+    }
+    return MPU_CAL_DONE;
+  }
+
+  bool read(Offsets& offsets) {
+    uint8_t buffer[6];
+    if (!_mpu.readRegisters(MPU_CAL_REG_ACCEL_OFFS, buffer, sizeof(buffer))) return false;
+    for (int i = 0; i < 3; i++) offsets.accel[i] = (int16_t)((buffer[2 * i] << 8) | buffer[2 * i + 1]);
+    if (!_mpu.readRegisters(MPU_CAL_REG_GYRO_OFFS, buffer, sizeof(buffer))) return false;
+    for (int i = 0; i < 3; i++) offsets.gyro[i] = (int16_t)((buffer[2 * i] << 8) | buffer[2 * i + 1]);
+    return true;
+  }
+
+  bool write(const Offsets& offsets) {
+    for (int i = 0; i < 3; i++) {
+      if (!_mpu.writeRegister(MPU_CAL_REG_ACCEL_OFFS + 2 * i, (uint8_t)(offsets.accel[i] >> 8)) ||
+          !_mpu.writeRegister(MPU_CAL_REG_ACCEL_OFFS + 2 * i + 1, (uint8_t)offsets.accel[i]) ||
+          !_mpu.writeRegister(MPU_CAL_REG_GYRO_OFFS + 2 * i, (uint8_t)(offsets.gyro[i] >> 8)) ||
+          !_mpu.writeRegister(MPU_CAL_REG_GYRO_OFFS + 2 * i + 1, (uint8_t)offsets.gyro[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  MpuRaw& _mpu;
+  MpuCalibrationStatus _status;
+  char _key[8];
+};
+
+#endif
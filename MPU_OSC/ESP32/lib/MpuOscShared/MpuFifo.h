@@ -0,0 +1,138 @@
+/**
+ * MPU6050 hardware FIFO streaming of accelerometer + gyroscope frames.
+ *
+ * The sensor writes every sample into its 1 KB FIFO as a 12-byte frame
+ * (ax ay az gx gy gz, big-endian), so the MCU no longer has to be there for
+ * each sample: drain() reads everything that piled up in a few bursts,
+ * whenever the task gets to it. 85 frames fit, i.e. 850 ms at 100 Hz.
+ *
+ * When the FIFO overflows the sensor overwrites the oldest bytes and, as
+ * 1024 is not a multiple of 12, frame alignment is lost. The FIFO is then
+ * reset and drain() reports the overflow; the frames that were in it are gone.
+ *
+ * Works on the registers through MpuRaw, so it sits under either library.
+ */
+#ifndef MPU_FIFO_H
+#define MPU_FIFO_H
+
+#include "MpuRaw.h"
+
+#define MPU_FIFO_REG_FIFO_EN 0x23
+#define MPU_FIFO_REG_INT_ENABLE 0x38
+#define MPU_FIFO_REG_INT_STATUS 0x3A
+#define MPU_FIFO_REG_USER_CTRL 0x6A
+#define MPU_FIFO_REG_COUNT_H 0x72
+#define MPU_FIFO_REG_R_W 0x74
+
+#define MPU_FIFO_ACCEL_GYRO 0x78 // FIFO_EN: XG, YG, ZG and ACCEL, no temperature
+#define MPU_FIFO_USER_EN 0x40    // USER_CTRL: FIFO_EN
+#define MPU_FIFO_USER_RESET 0x04 // USER_CTRL: FIFO_RESET
+#define MPU_FIFO_OFLOW 0x10      // INT_ENABLE / INT_STATUS: FIFO_OFLOW
+
+#define MPU_FIFO_SIZE 1024
+#define MPU_FIFO_FRAME_BYTES 12
+#define MPU_FIFO_MAX_FRAMES (MPU_FIFO_SIZE / MPU_FIFO_FRAME_BYTES)
+#define MPU_FIFO_BURST_FRAMES 10 // 120 bytes per transaction, inside the 128-byte Wire buffer
+
+class MpuFifo {
+public:
+  explicit MpuFifo(MpuRaw& mpu) : _mpu(mpu), _frames(0), _overflows(0) {}
+
+  /**
+   * @brief Streams accelerometer and gyroscope into the FIFO, starting empty.
+   */
+  bool begin() {
+    return _mpu.writeRegister(MPU_FIFO_REG_FIFO_EN, MPU_FIFO_ACCEL_GYRO) &&
+           _mpu.updateRegister(MPU_FIFO_REG_INT_ENABLE, MPU_FIFO_OFLOW, MPU_FIFO_OFLOW) &&
+           reset();
+  }
+
+  /**
+   * @brief Stops streaming into the FIFO.
+   */
+  bool end() {
+    return _mpu.writeRegister(MPU_FIFO_REG_FIFO_EN, 0) &&
+           _mpu.updateRegister(MPU_FIFO_REG_USER_CTRL, MPU_FIFO_USER_EN, 0);
+  }
+
+  /**
+   * @brief Empties the FIFO (and realigns it to a frame boundary); streaming continues.
+   */
+  bool reset() {
+    // FIFO_RESET only takes while FIFO_EN is off; the bit clears itself
+    return _mpu.updateRegister(MPU_FIFO_REG_USER_CTRL, MPU_FIFO_USER_EN | MPU_FIFO_USER_RESET, MPU_FIFO_USER_RESET) &&
+           _mpu.updateRegister(MPU_FIFO_REG_USER_CTRL, MPU_FIFO_USER_EN, MPU_FIFO_USER_EN);
+  }
+
+  /**
+   * @return The number of complete frames waiting, 0 on a bus error, or -1
+   *         after an overflow (the FIFO has been reset).
+   */
+  int available() {
+    uint8_t status;
+    uint8_t count[2];
+    if (!_mpu.readRegisters(MPU_FIFO_REG_INT_STATUS, &status, 1) ||
+        !_mpu.readRegisters(MPU_FIFO_REG_COUNT_H, count, 2)) return 0;
+    uint16_t bytes = ((uint16_t)count[0] << 8) | count[1];
+    if ((status & MPU_FIFO_OFLOW) || bytes >= MPU_FIFO_SIZE) {
+      _overflows++;
+      reset();
+      return -1;
+    }
+    // A frame still being written is left for the next drain
+    return bytes / MPU_FIFO_FRAME_BYTES;
+  }
+
+  /**
+   * @brief Reads frames that available() reported, in bursts.
+   *
+   * @param out May be NULL to discard the frames.
+   * @return The number of frames read; fewer than asked only on a bus error.
+   */
+  int read(MpuRawSample* out, int frames) {
+    uint8_t buffer[MPU_FIFO_BURST_FRAMES * MPU_FIFO_FRAME_BYTES];
+    int done = 0;
+    while (done < frames) {
+      int n = frames - done;
+      if (n > MPU_FIFO_BURST_FRAMES) n = MPU_FIFO_BURST_FRAMES;
+      if (!_mpu.readRegisters(MPU_FIFO_REG_R_W, buffer, n * MPU_FIFO_FRAME_BYTES)) break;
+      if (out) {
+        for (int i = 0; i < n; i++) decode(buffer + i * MPU_FIFO_FRAME_BYTES, out[done + i]);
+      }
+      done += n;
+    }
+    _frames += done;
+    return done;
+  }
+
+  /**
+   * @brief Reads everything waiting, up to maxFrames (the rest stays for the next call).
+   *
+   * @return The number of frames read, or -1 after an overflow.
+   */
+  int drain(MpuRawSample* out, int maxFrames) {
+    int n = available();
+    if (n <= 0) return n;
+    if (n > maxFrames) n = maxFrames;
+    return read(out, n);
+  }
+
+  uint32_t frames() const { return _frames; }
+  uint32_t overflows() const { return _overflows; }
+
+private:
+  static void decode(const uint8_t* p, MpuRawSample& sample) {
+    sample.ax = (int16_t)((p[0] << 8) | p[1]);
+    sample.ay = (int16_t)((p[2] << 8) | p[3]);
+    sample.az = (int16_t)((p[4] << 8) | p[5]);
+    sample.gx = (int16_t)((p[6] << 8) | p[7]);
+    sample.gy = (int16_t)((p[8] << 8) | p[9]);
+    sample.gz = (int16_t)((p[10] << 8) | p[11]);
+  }
+
+  MpuRaw& _mpu;
+  uint32_t _frames;
+  uint32_t _overflows;
+};
+
+#endif
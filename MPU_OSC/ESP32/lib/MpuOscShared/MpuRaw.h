@@ -0,0 +1,165 @@
+/**
+ * Raw MPU6050 motion reads: ACCEL_XOUT_H..GYRO_ZOUT_L in one I2C transaction.
+ *
+ * getAcceleration() followed by getRotation() addresses the chip twice; the
+ * Adafruit getEvent() also converts every field to SI units. read() sets the
+ * register pointer once and bursts all 14 bytes, returning int16 counts.
+ *
+ * Temperature sits between the accelerometer and gyroscope registers, so
+ * leaving it out on the bus would take a second transaction, which costs more
+ * than the two bytes it saves. read() therefore always bursts 14 bytes and
+ * only skips decoding the temperature unless asked for it; readSplit() is the
+ * two-transaction variant, kept for the bus benchmark.
+ *
+ * Samples stay in counts. accelScale() and gyroScale() give the factors to
+ * m/s^2 and rad/s for the ranges readScales() found, so only the code that
+ * really wants SI floats pays for the conversion.
+ */
+#ifndef MPU_RAW_H
+#define MPU_RAW_H
+
+#include <stdint.h>
+#include <math.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Wire.h>
+#endif
+
+#define MPU_RAW_ACCEL_XOUT_H 0x3B
+#define MPU_RAW_GYRO_XOUT_H 0x43
+#define MPU_RAW_MOTION_BYTES 14
+#define MPU_RAW_GYRO_CONFIG 0x1B
+#define MPU_RAW_ACCEL_CONFIG 0x1C
+#define MPU_RAW_STANDARD_GRAVITY 9.80665f
+
+// AFS_SEL / FS_SEL 0..3: +-2..16 g, +-250..2000 deg/s over 32768 counts
+inline float mpuRawAccelScale(uint8_t range) {
+  return (2 << range) * MPU_RAW_STANDARD_GRAVITY / 32768.0f;
+}
+
+inline float mpuRawGyroScale(uint8_t range) {
+  return (250 << range) * (float)(M_PI / 180) / 32768.0f;
+}
+
+struct MpuRawSample {
+  int16_t ax, ay, az;
+  int16_t temp; // only filled by read(sample, true)
+  int16_t gx, gy, gz;
+};
+
+// The bus side needs the Arduino core; the scales above also build on the host
+#ifdef ARDUINO
+class MpuRaw {
+public:
+  explicit MpuRaw(uint8_t address = 0x68, TwoWire& wire = Wire)
+    : _address(address), _wire(wire), _errors(0), _accelScale(0), _gyroScale(0) {
+    setScales(0, 0); // power-on ranges, +-2 g and +-250 deg/s
+  }
+
+  /**
+   * @brief Reads accelerometer, temperature and gyroscope in one 14-byte burst.
+   *
+   * @param withTemperature Also decode the temperature counts into sample.temp.
+   * @return false on a bus error; the sample is left untouched.
+   */
+  bool read(MpuRawSample& sample, bool withTemperature = false) {
+    uint8_t buffer[MPU_RAW_MOTION_BYTES];
+    if (!readRegisters(MPU_RAW_ACCEL_XOUT_H, buffer, sizeof(buffer))) return false;
+    sample.ax = be16(buffer + 0);
+    sample.ay = be16(buffer + 2);
+    sample.az = be16(buffer + 4);
+    if (withTemperature) sample.temp = be16(buffer + 6);
+    sample.gx = be16(buffer + 8);
+    sample.gy = be16(buffer + 10);
+    sample.gz = be16(buffer + 12);
+    return true;
+  }
+
+  /**
+   * @brief Reads accelerometer and gyroscope as two 6-byte transactions, skipping temperature on the bus.
+   */
+  bool readSplit(MpuRawSample& sample) {
+    uint8_t buffer[6];
+    if (!readRegisters(MPU_RAW_ACCEL_XOUT_H, buffer, sizeof(buffer))) return false;
+    sample.ax = be16(buffer + 0);
+    sample.ay = be16(buffer + 2);
+    sample.az = be16(buffer + 4);
+    if (!readRegisters(MPU_RAW_GYRO_XOUT_H, buffer, sizeof(buffer))) return false;
+    sample.gx = be16(buffer + 0);
+    sample.gy = be16(buffer + 2);
+    sample.gz = be16(buffer + 4);
+    return true;
+  }
+
+  /**
+   * @brief Sets the register pointer and reads count bytes with a repeated start.
+   */
+  bool readRegisters(uint8_t reg, uint8_t* data, uint8_t count) {
+    _wire.beginTransmission(_address);
+    _wire.write(reg);
+    if (_wire.endTransmission(false) != 0 || _wire.requestFrom(_address, (size_t)count) != count) {
+      _errors++;
+      return false;
+    }
+    for (uint8_t i = 0; i < count; i++) data[i] = _wire.read();
+    return true;
+  }
+
+  /**
+   * @brief Writes one register.
+   */
+  bool writeRegister(uint8_t reg, uint8_t value) {
+    _wire.beginTransmission(_address);
+    _wire.write(reg);
+    _wire.write(value);
+    if (_wire.endTransmission() != 0) {
+      _errors++;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read-modify-write: sets the bits of mask to those of value, leaves the others alone.
+   */
+  bool updateRegister(uint8_t reg, uint8_t mask, uint8_t value) {
+    uint8_t current;
+    if (!readRegisters(reg, &current, 1)) return false;
+    return writeRegister(reg, (current & ~mask) | (value & mask));
+  }
+
+  /**
+   * @brief Reads the full-scale ranges the chip is set to (by whichever library configured it).
+   */
+  bool readScales() {
+    uint8_t config[2]; // GYRO_CONFIG, ACCEL_CONFIG
+    if (!readRegisters(MPU_RAW_GYRO_CONFIG, config, sizeof(config))) return false;
+    setScales((config[1] >> 3) & 3, (config[0] >> 3) & 3);
+    return true;
+  }
+
+  // m/s^2 per accelerometer count
+  float accelScale() const { return _accelScale; }
+  // rad/s per gyroscope count
+  float gyroScale() const { return _gyroScale; }
+
+  uint8_t address() const { return _address; }
+  uint32_t errors() const { return _errors; }
+
+private:
+  static int16_t be16(const uint8_t* p) { return (int16_t)((p[0] << 8) | p[1]); }
+
+  void setScales(uint8_t accelRange, uint8_t gyroRange) {
+    _accelScale = mpuRawAccelScale(accelRange);
+    _gyroScale = mpuRawGyroScale(gyroRange);
+  }
+
+  uint8_t _address;
+  TwoWire& _wire;
+  uint32_t _errors;
+  float _accelScale;
+  float _gyroScale;
+};
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * Runtime-editable table of OSC listeners (ip, port).
+ *
+ * A packet is encoded once and then handed to send(), which writes the same
+ * bytes to every destination through a single WiFiUDP socket. Adding another
+ * listener costs one more datagram, not another encode or socket.
+ *
+ * Multicast and broadcast output bypass the table: UdpMulticastTransport
+ * (OSCTransport.h) sends through sendTo() so it shares the same counters.
+ *
+ * Hosts are resolved to an IPAddress when they are added or changed, never
+ * on the send path. send() keeps per-datagram timing counters (OSCSendStats).
+ *
+ * Edits may come from another task than send(): the table is guarded by a
+ * spinlock that send() only holds while copying it, never across a datagram.
+ */
+#ifndef OSC_DESTINATIONS_H
+#define OSC_DESTINATIONS_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+#ifndef MAX_OSC_DESTINATIONS
+#define MAX_OSC_DESTINATIONS 8
+#endif
+
+struct OSCDestination {
+  IPAddress ip;
+  uint16_t port;
+};
+
+struct OSCSendStats {
+  uint32_t packets;      // datagrams handed off successfully
+  uint32_t failures;     // beginPacket/endPacket errors
+  uint64_t totalMicros;  // time spent in beginPacket..endPacket
+  uint32_t maxMicros;
+
+  uint32_t averageMicros() const {
+    uint32_t n = packets + failures;
+    return n ? (uint32_t)(totalMicros / n) : 0;
+  }
+};
+
+class OSCDestinations {
+public:
+  OSCDestinations() : _count(0) {
+    resetStats();
+  }
+
+  /**
+   * @brief Parses a dotted IP, falling back to a DNS lookup for host names.
+   *
+   * @return false if the text is neither a valid address nor a known host.
+   */
+  static bool resolve(const String& host, IPAddress& ip) {
+    if (ip.fromString(host)) return true;
+    return host.length() > 0 && WiFi.hostByName(host.c_str(), ip) == 1;
+  }
+
+  /**
+   * @return false if the table is full or the destination is already listed.
+   */
+  bool add(const IPAddress& ip, uint16_t port) {
+    bool added = false;
+    portENTER_CRITICAL(&_mux);
+    if (_count < MAX_OSC_DESTINATIONS && indexOf(ip, port) < 0) {
+      _dest[_count].ip = ip;
+      _dest[_count].port = port;
+      _count++;
+      added = true;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return added;
+  }
+
+  bool remove(int index) {
+    if (index < 0 || index >= _count) return false;
+    portENTER_CRITICAL(&_mux);
+    for (int i = index; i < _count - 1; i++) _dest[i] = _dest[i + 1];
+    _count--;
+    portEXIT_CRITICAL(&_mux);
+    return true;
+  }
+
+  /**
+   * @brief Moves the destinations on host from to host to, keeping the ports.
+   *
+   * Listeners on other hosts stay where they are; an entry that would repeat
+   * one already on the new host is dropped.
+   */
+  void replaceIp(const IPAddress& from, const IPAddress& to) {
+    portENTER_CRITICAL(&_mux);
+    for (int i = 0; i < _count; i++) {
+      if (_dest[i].ip == from) _dest[i].ip = to;
+    }
+    int kept = 0;
+    for (int i = 0; i < _count; i++) {
+      int k = 0;
+      while (k < kept && !(_dest[k].ip == _dest[i].ip && _dest[k].port == _dest[i].port)) k++;
+      if (k == kept) _dest[kept++] = _dest[i];
+    }
+    _count = kept;
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  int indexOf(const IPAddress& ip, uint16_t port) const {
+    for (int i = 0; i < _count; i++) {
+      if (_dest[i].port == port && _dest[i].ip == ip) return i;
+    }
+    return -1;
+  }
+
+  int count() const { return _count; }
+  const OSCDestination& operator[](int index) const { return _dest[index]; }
+
+  const OSCSendStats& stats() const { return _stats; }
+  void resetStats() { memset(&_stats, 0, sizeof(_stats)); }
+
+  /**
+   * @brief Writes one encoded packet to every destination.
+   *
+   * @return The number of datagrams handed off to the network stack.
+   */
+  int send(WiFiUDP& udp, const uint8_t* data, size_t size) {
+    OSCDestination targets[MAX_OSC_DESTINATIONS];
+    int n;
+    portENTER_CRITICAL(&_mux);
+    for (n = 0; n < _count; n++) targets[n] = _dest[n];
+    portEXIT_CRITICAL(&_mux);
+
+    int sent = 0;
+    for (int i = 0; i < n; i++) {
+      if (sendTo(udp, targets[i].ip, targets[i].port, data, size)) sent++;
+    }
+    return sent;
+  }
+
+  /**
+   * @brief Writes one datagram to a single address, counted in stats().
+   */
+  bool sendTo(WiFiUDP& udp, const IPAddress& ip, uint16_t port, const uint8_t* data, size_t size) {
+    unsigned long start = micros();
+    bool ok = udp.beginPacket(ip, port);
+    if (ok) {
+      udp.write(data, size);
+      ok = udp.endPacket();
+    }
+    uint32_t elapsed = micros() - start;
+    _stats.totalMicros += elapsed;
+    if (elapsed > _stats.maxMicros) _stats.maxMicros = elapsed;
+    if (ok) _stats.packets++;
+    else _stats.failures++;
+    return ok;
+  }
+
+private:
+  OSCDestination _dest[MAX_OSC_DESTINATIONS];
+  int _count;
+  OSCSendStats _stats;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
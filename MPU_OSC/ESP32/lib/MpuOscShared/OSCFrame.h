@@ -0,0 +1,172 @@
+/**
+ * Fixed-layout OSC packet encoder.
+ *
+ * The address, type tag string and padding of every message are written once,
+ * when the layout is built at startup. After that only the argument slots (and
+ * the bundle timetag) are patched in place, so encoding a sample is a handful of
+ * byte swaps on a static buffer and never touches the heap.
+ *
+ * Usage:
+ *   frame.begin(true);                        // optional #bundle wrapper
+ *   int acc = frame.addMessage("/acc", "fff");
+ *   ...
+ *   frame.setFloat(acc + 0, ax);               // per sample
+ *   udp.write(frame.data(), frame.size());
+ */
+#ifndef OSC_FRAME_H
+#define OSC_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef OSC_FRAME_SIZE
+#define OSC_FRAME_SIZE 256
+#endif
+
+#ifndef OSC_FRAME_MAX_SLOTS
+#define OSC_FRAME_MAX_SLOTS 64
+#endif
+
+class OSCFrame {
+public:
+  OSCFrame() : _size(0), _slots(0), _bundle(false), _ok(true) {}
+
+  /**
+   * @brief Starts a new layout, dropping any previous one.
+   *
+   * @param bundle Wraps the messages in a "#bundle" with a patchable timetag.
+   */
+  void begin(bool bundle = false) {
+    _size = 0;
+    _slots = 0;
+    _ok = true;
+    _bundle = bundle;
+    if (_bundle) {
+      memcpy(_buf, "#bundle\0", 8);
+      memset(_buf + 8, 0, 8);
+      _buf[15] = 1; // "immediately" until a timetag is set
+      _size = 16;
+    }
+  }
+
+  /**
+   * @brief Appends a message with the given type tags to the layout.
+   *
+   * Supported tags: 'i' and 'f' (4 bytes), 'h' and 't' (8 bytes) and 'b'
+   * (a blob of exactly blobSize bytes). Each argument gets one slot, numbered
+   * in order across the whole frame.
+   *
+   * @return The slot index of the first argument, or -1 if the frame is full.
+   */
+  int addMessage(const char* address, const char* typetags, size_t blobSize = 0) {
+    size_t addrLen = pad4(strlen(address) + 1);
+    size_t tagLen = pad4(strlen(typetags) + 2); // leading ',' and trailing '\0'
+    size_t argLen = 0;
+    for (const char* t = typetags; *t; t++) {
+      int width = argWidth(*t, blobSize);
+      if (width < 0) {
+        _ok = false;
+        return -1;
+      }
+      argLen += width;
+    }
+    size_t msgLen = addrLen + tagLen + argLen;
+    size_t needed = msgLen + (_bundle ? 4 : 0);
+    size_t nTags = strlen(typetags);
+    if (_size + needed > OSC_FRAME_SIZE || _slots + nTags > OSC_FRAME_MAX_SLOTS || (!_bundle && _size > 0)) {
+      _ok = false;
+      return -1;
+    }
+
+    uint8_t* p = _buf + _size;
+    memset(p, 0, needed);
+    if (_bundle) {
+      putBE32(p, (uint32_t)msgLen);
+      p += 4;
+    }
+    memcpy(p, address, strlen(address));
+    p += addrLen;
+    p[0] = ',';
+    memcpy(p + 1, typetags, nTags);
+    p += tagLen;
+
+    int first = _slots;
+    for (const char* t = typetags; *t; t++) {
+      _slot[_slots++] = (uint16_t)(p - _buf);
+      if (*t == 'b') putBE32(p, (uint32_t)blobSize);
+      p += argWidth(*t, blobSize);
+    }
+    _size += needed;
+    return first;
+  }
+
+  void setFloat(int slot, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    putBE32(_buf + _slot[slot], bits);
+  }
+
+  void setInt(int slot, int32_t value) {
+    putBE32(_buf + _slot[slot], (uint32_t)value);
+  }
+
+  void setInt64(int slot, int64_t value) {
+    putBE32(_buf + _slot[slot], (uint32_t)((uint64_t)value >> 32));
+    putBE32(_buf + _slot[slot] + 4, (uint32_t)value);
+  }
+
+  /**
+   * @return Pointer to the payload of a 'b' slot, right after its length word.
+   */
+  uint8_t* blob(int slot) {
+    return _buf + _slot[slot] + 4;
+  }
+
+  /**
+   * @brief Patches the bundle timetag (NTP format: seconds + 2^-32 fractions).
+   */
+  void setTimetag(uint32_t seconds, uint32_t fraction) {
+    if (!_bundle) return;
+    putBE32(_buf + 8, seconds);
+    putBE32(_buf + 12, fraction);
+  }
+
+  const uint8_t* data() const { return _buf; }
+  size_t size() const { return _size; }
+  bool ok() const { return _ok; }
+
+private:
+  static size_t pad4(size_t n) { return (n + 3) & ~(size_t)3; }
+
+  static int argWidth(char tag, size_t blobSize) {
+    switch (tag) {
+      case 'i':
+      case 'f':
+        return 4;
+      case 'h':
+      case 't':
+        return 8;
+      case 'b':
+        return 4 + (int)pad4(blobSize);
+      default:
+        return -1;
+    }
+  }
+
+  static void putBE32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+  }
+
+  uint8_t _buf[OSC_FRAME_SIZE];
+  uint16_t _slot[OSC_FRAME_MAX_SLOTS];
+  size_t _size;
+  int _slots;
+  bool _bundle;
+  bool _ok;
+};
+
+#endif
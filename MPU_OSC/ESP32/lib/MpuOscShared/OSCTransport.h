@@ -0,0 +1,217 @@
+/**
+ * Where encoded OSC packets go once they are built.
+ *
+ * sendOSCMessages() and friends encode a packet once and hand it to an
+ * OSCTransport, so the wire is picked in one place instead of in every send
+ * function. Backends:
+ * - UdpTransport: one datagram per entry of the OSCDestinations table
+ * - UdpMulticastTransport: one datagram to a multicast group or the subnet broadcast address
+ * - SlipSerialTransport: SLIP-framed stream, typically the USB serial port
+ * - LoopbackTransport: keeps the packet in memory, for benchmarks and self-checks
+ *
+ * SlipSerialTransport frames each packet the way OSC 1.1 specifies for
+ * stream transports: SLIP (RFC 1055) with an END byte before and after the
+ * packet, END/ESC bytes inside it escaped.
+ *
+ * Only OSCTransport and LoopbackTransport build off the ESP32 (native tests).
+ */
+#ifndef OSC_TRANSPORT_H
+#define OSC_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "OSCDestinations.h"
+#endif
+
+enum OSCOutputMode {
+  OSC_OUTPUT_UNICAST,
+  OSC_OUTPUT_MULTICAST,
+  OSC_OUTPUT_BROADCAST
+};
+
+class OSCTransport {
+public:
+  virtual ~OSCTransport() {}
+
+  /**
+   * @brief Sends one encoded OSC packet (message or bundle).
+   *
+   * @return The number of copies handed off: one per UDP destination, 1 for a stream.
+   */
+  virtual int send(const uint8_t* data, size_t size) = 0;
+
+  virtual const char* name() const = 0;
+};
+
+#ifdef ARDUINO
+/**
+ * Datagrams through one WiFiUDP socket to every entry of the destination table.
+ */
+class UdpTransport : public OSCTransport {
+public:
+  UdpTransport(WiFiUDP& udp, OSCDestinations& destinations) : _udp(udp), _destinations(destinations) {}
+
+  int send(const uint8_t* data, size_t size) override {
+    return _destinations.send(_udp, data, size);
+  }
+
+  const char* name() const override { return "udp"; }
+
+private:
+  WiFiUDP& _udp;
+  OSCDestinations& _destinations;
+};
+
+/**
+ * Each packet goes out once, to a multicast group (e.g. 239.0.0.57) or the
+ * subnet broadcast address, and any number of listeners can receive it.
+ * Datagrams are counted in the destination table's stats().
+ */
+class UdpMulticastTransport : public OSCTransport {
+public:
+  UdpMulticastTransport(WiFiUDP& udp, OSCDestinations& destinations)
+    : _udp(udp), _destinations(destinations), _port(0), _broadcast(false) {}
+
+  /**
+   * @brief Points the transport at a group; may be called while another task sends.
+   */
+  void setGroup(const IPAddress& group, uint16_t port, bool broadcast = false) {
+    portENTER_CRITICAL(&_mux);
+    _group = group;
+    _port = port;
+    _broadcast = broadcast;
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  int send(const uint8_t* data, size_t size) override {
+    portENTER_CRITICAL(&_mux);
+    IPAddress group = _group;
+    uint16_t port = _port;
+    portEXIT_CRITICAL(&_mux);
+    return _destinations.sendTo(_udp, group, port, data, size) ? 1 : 0;
+  }
+
+  const char* name() const override { return _broadcast ? "broadcast" : "multicast"; }
+
+  const IPAddress& group() const { return _group; }
+  uint16_t port() const { return _port; }
+
+private:
+  WiFiUDP& _udp;
+  OSCDestinations& _destinations;
+  IPAddress _group;
+  uint16_t _port;
+  bool _broadcast;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+/**
+ * SLIP-framed packets on a byte stream, typically the USB serial port.
+ */
+class SlipSerialTransport : public OSCTransport {
+public:
+  explicit SlipSerialTransport(Print& out) : _out(out), _frames(0), _bytes(0) {}
+
+  int send(const uint8_t* data, size_t size) override {
+    // Encoded in small chunks so a packet costs a few write() calls, not one per byte
+    uint8_t chunk[64];
+    size_t n = 0;
+    chunk[n++] = SLIP_END;
+    for (size_t i = 0; i < size; i++) {
+      if (n > sizeof(chunk) - 2) {
+        _bytes += _out.write(chunk, n);
+        n = 0;
+      }
+      uint8_t b = data[i];
+      if (b == SLIP_END) {
+        chunk[n++] = SLIP_ESC;
+        chunk[n++] = SLIP_ESC_END;
+      } else if (b == SLIP_ESC) {
+        chunk[n++] = SLIP_ESC;
+        chunk[n++] = SLIP_ESC_ESC;
+      } else {
+        chunk[n++] = b;
+      }
+    }
+    if (n == sizeof(chunk)) {
+      _bytes += _out.write(chunk, n);
+      n = 0;
+    }
+    chunk[n++] = SLIP_END;
+    _bytes += _out.write(chunk, n);
+    _frames++;
+    return 1;
+  }
+
+  const char* name() const override { return "serial"; }
+
+  uint32_t frames() const { return _frames; }
+  uint32_t bytes() const { return _bytes; }
+
+private:
+  Print& _out;
+  uint32_t _frames;
+  uint32_t _bytes;
+};
+
+#endif
+
+#ifndef LOOPBACK_TRANSPORT_SIZE
+#define LOOPBACK_TRANSPORT_SIZE 1536
+#endif
+
+/**
+ * Copies each packet into memory instead of sending it, so the whole
+ * encode + send path can be timed or checked without a network.
+ */
+class LoopbackTransport : public OSCTransport {
+public:
+  LoopbackTransport() : _size(0), _packets(0), _bytes(0), _truncated(0) {}
+
+  int send(const uint8_t* data, size_t size) override {
+    if (size > sizeof(_last)) {
+      size = sizeof(_last);
+      _truncated++;
+    }
+    memcpy(_last, data, size);
+    _size = size;
+    _packets++;
+    _bytes += size;
+    return 1;
+  }
+
+  const char* name() const override { return "loopback"; }
+
+  // The most recent packet
+  const uint8_t* data() const { return _last; }
+  size_t size() const { return _size; }
+
+  uint32_t packets() const { return _packets; }
+  uint64_t bytes() const { return _bytes; }
+  uint32_t truncated() const { return _truncated; }
+
+  void reset() {
+    _size = 0;
+    _packets = 0;
+    _bytes = 0;
+    _truncated = 0;
+  }
+
+private:
+  uint8_t _last[LOOPBACK_TRANSPORT_SIZE];
+  size_t _size;
+  uint32_t _packets;
+  uint64_t _bytes;
+  uint32_t _truncated;
+};
+
+#endif
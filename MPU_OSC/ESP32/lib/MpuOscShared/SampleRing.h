@@ -0,0 +1,74 @@
+/**
+ * Lock-free single-producer/single-consumer ring buffer for sensor samples.
+ *
+ * The sampling side calls push() and never blocks: when the ring is full the
+ * oldest sample is dropped, so a stalled network task only loses stale data.
+ * The network side calls pop(). Dropping the oldest entry means the producer
+ * also advances the read index, so both sides claim it with a compare-exchange;
+ * a consumer that loses that race discards its copy and retries.
+ *
+ * N must be a power of two.
+ */
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SampleRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SampleRing depth must be a power of two");
+
+public:
+  SampleRing() : _head(0), _tail(0), _produced(0), _dropped(0) {}
+
+  /**
+   * @brief Producer only. Stores a sample, dropping the oldest one if the ring is full.
+   */
+  void push(const T& item) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+    if (head - tail >= N) {
+      // Full: claim the oldest slot before overwriting it
+      if (_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    _items[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);
+    _produced.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Consumer only. Takes the oldest sample.
+   *
+   * @return false if the ring is empty.
+   */
+  bool pop(T& item) {
+    for (;;) {
+      uint32_t tail = _tail.load(std::memory_order_acquire);
+      if (tail == _head.load(std::memory_order_acquire)) return false;
+      item = _items[tail & (N - 1)];
+      // Fails if the producer dropped this slot (and may have overwritten it) meanwhile
+      if (_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) return true;
+    }
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  static size_t capacity() { return N; }
+  uint32_t produced() const { return _produced.load(std::memory_order_relaxed); }
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  T _items[N];
+  std::atomic<uint32_t> _head;
+  std::atomic<uint32_t> _tail;
+  std::atomic<uint32_t> _produced;
+  std::atomic<uint32_t> _dropped;
+};
+
+#endif
@@ -1,7 +1,10 @@
 import time
+import heapq
 import math
-from pythonosc.dispatcher import Dispatcher
-from pythonosc.osc_server import BlockingOSCUDPServer
+import socket
+import struct
+import argparse
+from pythonosc.osc_packet import OscPacket, ParseError
 import rtmidi
 import threading
 import sys
@@ -26,6 +29,47 @@ if midi_port_index is None:
     print("LoopMIDI port 3 not found. Available ports:", available_ports)
     exit(1)
 midiout.open_port(midi_port_index)
+midi_lock = threading.Lock()
+
+def send_midi(message):
+    # MIDI goes out from the OSC thread and the scheduler thread
+    with midi_lock:
+        midiout.send_message(message)
+
+class MidiScheduler:
+    """Runs callbacks at given wall-clock times (time.time()) from one dedicated thread."""
+
+    def __init__(self):
+        self.queue = []  # (when, order, fn, args)
+        self.order = 0
+        self.cond = threading.Condition()
+        threading.Thread(target=self.run, daemon=True).start()
+
+    def at(self, when, fn, *args):
+        with self.cond:
+            heapq.heappush(self.queue, (when, self.order, fn, args))
+            self.order += 1
+            self.cond.notify()
+
+    def run(self):
+        while True:
+            with self.cond:
+                while not self.queue:
+                    self.cond.wait()
+                delay = self.queue[0][0] - time.time()
+                if delay > 0:
+                    # Woken early if something sooner gets scheduled
+                    self.cond.wait(delay)
+                    continue
+                _, _, fn, args = heapq.heappop(self.queue)
+            fn(*args)
+
+midi_scheduler = MidiScheduler()
+NOTE_LENGTH = 0.1  # seconds from note on to note off
+# Notes closer together are dropped, so the playing speed does not follow the sample rate
+MIN_NOTE_INTERVAL = 0.15  # seconds, about the 6-7 notes/s of the old sleep-throttled loop
+last_note_time = 0.0
+verbose = False  # print every OSC message (--verbose)
 
 # Major scale (C major as example)
 MAJOR_SCALE = [0, 2, 4, 5, 7, 9, 11]  # C D E F G A B
@@ -38,6 +82,10 @@ BASE_MIDI_NOTE = 36  # C2, adjust as needed
 last_angle = 0.0
 # Store latest /acc y value for velocity (teapot output)
 latest_acc_y = None
+# Latest DMP orientation: (yaw, pitch, roll) in degrees and the (w, x, y, z) quaternion.
+# Once /ypr arrives it drives the notes and raw gyro rates only feed the plots.
+latest_ypr = None
+latest_quat = None
 latest_opt_value = 1  # Start with opt=1
 
 # Buffers for plotting
@@ -58,6 +106,18 @@ def gyr_to_midi(x_deg, y_deg, z_deg):
     roll_norm = (x_deg + 36000) / 72000  # 0 to 1
     octave = int(roll_norm * OCTAVES) % OCTAVES
     midi_note = BASE_MIDI_NOTE + octave * 12 + MAJOR_SCALE[scale_degree]
+    velocity = play_note(midi_note)
+    if velocity is None:
+        return
+    print(f"[MIDI] note={midi_note}, velocity={velocity}, roll={x_deg:.1f}, pitch={y_deg:.1f}, scale_degree={scale_degree}, octave={octave}")
+
+def play_note(midi_note):
+    # Returns the velocity, or None if the previous note was too recent
+    global last_note_time
+    now = time.time()
+    if now - last_note_time < MIN_NOTE_INTERVAL:
+        return None
+    last_note_time = now
     # Use latest_acc_y for velocity, scale to 0-127 (teapot output, -2000 to +2000 typical range)
     if latest_acc_y is not None:
         velocity = int(max(0, min(127, ((latest_acc_y + 2000) / 4000) * 127)))
@@ -66,10 +126,38 @@ def gyr_to_midi(x_deg, y_deg, z_deg):
     # Send MIDI note on channel 2 (0x91)
     note_on = [0x91, midi_note, velocity]
     note_off = [0x81, midi_note, 0]
-    midiout.send_message(note_on)
-    time.sleep(0.1)
-    midiout.send_message(note_off)
-    print(f"[MIDI] note={midi_note}, velocity={velocity}, roll={x_deg:.1f}, pitch={y_deg:.1f}, scale_degree={scale_degree}, octave={octave}")
+    send_midi(note_on)
+    # Note off is scheduled, so the OSC thread never sleeps through incoming packets
+    midi_scheduler.at(now + NOTE_LENGTH, send_midi, note_off)
+    return velocity
+
+# Map the DMP's orientation to notes: pitch picks the scale degree, roll the octave
+def ypr_to_midi(yaw, pitch, roll):
+    # pitch: -90 to +90 degrees, roll and yaw: -180 to +180 degrees
+    pitch_norm = (pitch + 90) / 180  # 0 to 1
+    scale_degree = min(int(pitch_norm * NOTES_PER_OCTAVE), NOTES_PER_OCTAVE - 1)
+    roll_norm = (roll + 180) / 360  # 0 to 1
+    octave = min(int(roll_norm * OCTAVES), OCTAVES - 1)
+    midi_note = BASE_MIDI_NOTE + octave * 12 + MAJOR_SCALE[scale_degree]
+    velocity = play_note(midi_note)
+    if velocity is None:
+        return
+    print(f"[MIDI] note={midi_note}, velocity={velocity}, roll={roll:.1f}, pitch={pitch:.1f}, scale_degree={scale_degree}, octave={octave}")
+
+def ypr_to_cc(yaw, pitch, roll, mode='all'):
+    # Same controllers and channels as gyr_to_cc, from true angles
+    def map_cc(val, span):
+        return int(max(0, min(127, ((val + span) / (2 * span)) * 127)))
+    cc_x = map_cc(roll, 180)
+    cc_y = map_cc(pitch, 90)
+    cc_z = map_cc(yaw, 180)
+    if mode in ('all', 'roll'):
+        send_midi([0xB0, 11, cc_x])
+    if mode in ('all', 'pitch'):
+        send_midi([0xB0 if mode == 'all' else 0xB1, 12, cc_y])
+    if mode in ('all', 'yaw'):
+        send_midi([0xB0 if mode == 'all' else 0xB2, 13, cc_z])
+    print(f"[MIDI CC] CC11={cc_x}, CC12={cc_y}, CC13={cc_z} ({mode}), roll={roll:.1f}, pitch={pitch:.1f}, yaw={yaw:.1f}")
 
 def gyr_to_cc(x_deg, y_deg, z_deg, mode='all'):
     # Map -180 to +180 (or -1800 to +1800) to 0-127 for MIDI CC
@@ -83,21 +171,21 @@ def gyr_to_cc(x_deg, y_deg, z_deg, mode='all'):
     cc_z = map_cc(z_deg)
     if mode == 'all':
         # Send CC11, CC12, CC13 all on channel 1
-        midiout.send_message([0xB0, 11, cc_x])  # Roll, channel 1
-        midiout.send_message([0xB0, 12, cc_y])  # Pitch, channel 1
-        midiout.send_message([0xB0, 13, cc_z])  # Yaw, channel 1
+        send_midi([0xB0, 11, cc_x])  # Roll, channel 1
+        send_midi([0xB0, 12, cc_y])  # Pitch, channel 1
+        send_midi([0xB0, 13, cc_z])  # Yaw, channel 1
         print(f"[MIDI CC] CC11={cc_x}, CC12={cc_y}, CC13={cc_z} (all ch1), roll={x_deg:.1f}, pitch={y_deg:.1f}, yaw={z_deg:.1f}")
     elif mode == 'roll':
         # Send CC11 on channel 11 (0xB0)
-        midiout.send_message([0xB0, 11, cc_x])
+        send_midi([0xB0, 11, cc_x])
         print(f"[MIDI CC] CC11={cc_x} (roll), channel 11, roll={x_deg:.1f}")
     elif mode == 'pitch':
         # Send CC12 on channel 12 (0xB1)
-        midiout.send_message([0xB1, 12, cc_y])
+        send_midi([0xB1, 12, cc_y])
         print(f"[MIDI CC] CC12={cc_y} (pitch), channel 12, pitch={y_deg:.1f}")
     elif mode == 'yaw':
         # Send CC13 on channel 13 (0xB2)
-        midiout.send_message([0xB2, 13, cc_z])
+        send_midi([0xB2, 13, cc_z])
         print(f"[MIDI CC] CC13={cc_z} (yaw), channel 13, yaw={z_deg:.1f}")
 
 def update_gyr_plot(new_x, new_y, new_z):
@@ -112,6 +200,24 @@ def update_acc_plot(new_x, new_y, new_z):
         acc_data = np.roll(acc_data, -1, axis=0)
         acc_data[-1] = [new_x, new_y, new_z]
 
+def append_plot_samples(samples):
+    # Vectorized update_acc_plot/update_gyr_plot for an (n, 6) block of ax ay az gx gy gz
+    global acc_data, gyr_data
+    n = min(len(samples), PLOT_LEN)
+    with acc_lock:
+        acc_data = np.roll(acc_data, -n, axis=0)
+        acc_data[-n:] = samples[-n:, 0:3]
+    with gyr_lock:
+        gyr_data = np.roll(gyr_data, -n, axis=0)
+        gyr_data[-n:] = samples[-n:, 3:6]
+
+def hold_plot_samples():
+    # The sender skips samples that stayed inside its dead-band: repeat the held
+    # values so the traces keep scrolling instead of freezing
+    with acc_lock, gyr_lock:
+        held = np.concatenate((acc_data[-1], gyr_data[-1]))[np.newaxis, :]
+    append_plot_samples(held)
+
 def plot_window():
     app = QApplication(sys.argv)
     fig, axs = plt.subplots(2, 1, figsize=(8, 6))
@@ -164,51 +270,497 @@ def plot_window():
     plt.show()
     app.exec_()
 
+def play_gyr(x, y, z):
+    opt = latest_opt_value if latest_opt_value is not None else 1
+    if opt == 1:
+        gyr_to_midi(x, y, z)
+    elif opt == 2:
+        gyr_to_midi(x, y, z)
+        gyr_to_cc(x, y, z, mode='all')
+    elif opt == 3:
+        gyr_to_cc(x, y, z, mode='roll')
+    elif opt == 4:
+        gyr_to_cc(x, y, z, mode='pitch')
+    elif opt == 5:
+        gyr_to_cc(x, y, z, mode='yaw')
+
+def play_ypr(yaw, pitch, roll):
+    opt = latest_opt_value if latest_opt_value is not None else 1
+    if opt in (1, 2):
+        ypr_to_midi(yaw, pitch, roll)
+    if opt == 2:
+        ypr_to_cc(yaw, pitch, roll, mode='all')
+    elif opt == 3:
+        ypr_to_cc(yaw, pitch, roll, mode='roll')
+    elif opt == 4:
+        ypr_to_cc(yaw, pitch, roll, mode='pitch')
+    elif opt == 5:
+        ypr_to_cc(yaw, pitch, roll, mode='yaw')
+
+class LinkStats:
+    """Loss, reordering and RFC 3550 inter-arrival jitter from the packet seq/timestamp args.
+
+    Every sample datagram carries a sequence number and the device timestamp in
+    microseconds; messages of one bundle share them, so repeats are ignored.
+    Once the device is clock-synced its bundle timetags are in our wall-clock
+    time, which also gives the one-way latency.
+    """
+    RESTART_GAP = 1000  # a seq this far behind means the device rebooted
+
+    def __init__(self, report_interval=5.0):
+        self.report_interval = report_interval
+        self.arrival = 0.0
+        self.reset()
+        self.reset_latency()
+        self.last_report = time.monotonic()
+
+    def reset(self):
+        self.base_seq = None
+        self.max_seq = None
+        self.received = 0
+        self.reordered = 0
+        self.transit = None
+        self.jitter = 0.0  # seconds
+
+    def reset_latency(self):
+        self.latency_count = 0
+        self.latency_sum = 0.0
+        self.latency_min = float("inf")
+        self.latency_max = float("-inf")
+
+    def begin_packet(self, arrival):
+        self.arrival = arrival
+
+    def add_timetag(self, timetag):
+        # Before the device has synced, timetags count from its boot and say nothing about latency
+        if timetag < SYNCED_TIMETAG_MIN:
+            return
+        latency = self.arrival - timetag
+        self.latency_count += 1
+        self.latency_sum += latency
+        self.latency_min = min(self.latency_min, latency)
+        self.latency_max = max(self.latency_max, latency)
+
+    def update(self, seq, device_us):
+        seq &= 0xFFFFFFFF
+        if self.max_seq is None:
+            self.base_seq = self.max_seq = seq
+            self.received = 1
+            self.transit = self.arrival - device_us / 1e6
+            return
+        delta = (seq - self.max_seq) & 0xFFFFFFFF
+        if delta == 0:
+            return  # another message of the same datagram
+        if delta >= 0x80000000:
+            # Older than the newest seen: reordered, or the sender restarted
+            if 0x100000000 - delta > self.RESTART_GAP:
+                self.reset()
+                self.update(seq, device_us)
+                return
+            self.received += 1
+            self.reordered += 1
+            return
+        self.max_seq = seq
+        self.received += 1
+        transit = self.arrival - device_us / 1e6
+        self.jitter += (abs(transit - self.transit) - self.jitter) / 16
+        self.transit = transit
+
+    def expected(self):
+        if self.max_seq is None:
+            return 0
+        return ((self.max_seq - self.base_seq) & 0xFFFFFFFF) + 1
+
+    def maybe_report(self):
+        now = time.monotonic()
+        if now - self.last_report < self.report_interval or self.max_seq is None:
+            return
+        self.last_report = now
+        expected = self.expected()
+        lost = max(0, expected - self.received)
+        latency = ""
+        if self.latency_count:
+            latency = (f", latency={self.latency_sum / self.latency_count * 1000:.1f} ms "
+                       f"(min {self.latency_min * 1000:.1f}, max {self.latency_max * 1000:.1f})")
+            self.reset_latency()
+        print(f"[LINK] received={self.received}, lost={lost} ({100.0 * lost / expected:.2f}%), "
+              f"reordered={self.reordered}, jitter={self.jitter * 1000:.2f} ms{latency}")
+
+# Timetags after 2001 are synced wall-clock times; earlier ones are device uptime
+SYNCED_TIMETAG_MIN = 1e9
+NTP_UNIX_OFFSET = 2208988800  # seconds from 1900 (OSC timetags) to 1970
+OSC_IMMEDIATELY = 1  # the timetag that means "now"
+OSC_BUNDLE_HEADER = b"#bundle\x00"
+
+def osc_timetag(raw):
+    """Unix seconds of a raw 64-bit OSC timetag, None for "immediately"."""
+    if raw == OSC_IMMEDIATELY:
+        return None
+    return (raw >> 32) - NTP_UNIX_OFFSET + (raw & 0xFFFFFFFF) / 2**32
+
+def bundle_timetag(data):
+    """The timetag of a bundle datagram as sent, None for a plain message.
+
+    Read from the bytes themselves: python-osc replaces every timetag that has
+    already passed with its own parse time, which is exactly the stamps we need.
+    """
+    if not data.startswith(OSC_BUNDLE_HEADER) or len(data) < 16:
+        return None
+    return osc_timetag(struct.unpack_from(">Q", data, 8)[0])
+
+link_stats = LinkStats()
+
+class PlayoutBuffer:
+    """Plays samples at their device time plus a fixed target latency instead of on arrival.
+
+    With a clock-synced bundle the timetag already is our wall-clock time of the
+    sample. Otherwise the device timestamp is mapped through the smallest transit
+    time seen (the fastest packet sets the baseline), which creeps up slowly so
+    crystal drift cannot leave it stale. Packets that arrive after their play
+    time are dropped; the scheduler plays the rest in time order, which also
+    undoes any reordering on the way.
+    """
+    DRIFT_ALLOWANCE = 100e-6  # seconds per second the transit baseline may creep up
+    RESTART_STEP = 1.0  # a device timestamp this far back means the device rebooted
+
+    def __init__(self, scheduler, target_latency, report_interval=5.0):
+        self.scheduler = scheduler
+        self.target_latency = target_latency
+        self.report_interval = report_interval
+        self.base_transit = None
+        self.last_device_s = None
+        self.last_update = time.monotonic()
+        self.last_report = time.monotonic()
+        self.lock = threading.Lock()
+        self.pending = 0
+        self.scheduled = 0
+        self.played = 0
+        self.late = 0
+        self.occupancy_sum = 0
+        self.occupancy_max = 0
+
+    def play_time(self, device_us, timetag, arrival):
+        device_s = device_us / 1e6
+        transit = arrival - device_s
+        now = time.monotonic()
+        if self.last_device_s is not None and device_s < self.last_device_s - self.RESTART_STEP:
+            self.base_transit = None
+        if self.base_transit is None or transit < self.base_transit:
+            self.base_transit = transit
+        else:
+            self.base_transit += (now - self.last_update) * self.DRIFT_ALLOWANCE
+        self.last_update = now
+        self.last_device_s = device_s
+        if timetag is not None and timetag >= SYNCED_TIMETAG_MIN:
+            return timetag + self.target_latency
+        return device_s + self.base_transit + self.target_latency
+
+    def schedule(self, device_us, timetag, arrival, fn, *args):
+        when = self.play_time(device_us, timetag, arrival)
+        if when < time.time():
+            self.late += 1
+            return
+        with self.lock:
+            self.pending += 1
+            self.scheduled += 1
+            self.occupancy_sum += self.pending
+            self.occupancy_max = max(self.occupancy_max, self.pending)
+        self.scheduler.at(when, self.play, fn, args)
+
+    def play(self, fn, args):
+        with self.lock:
+            self.pending -= 1
+            self.played += 1
+        fn(*args)
+
+    def maybe_report(self):
+        now = time.monotonic()
+        if now - self.last_report < self.report_interval:
+            return
+        self.last_report = now
+        with self.lock:
+            mean = self.occupancy_sum / self.scheduled if self.scheduled else 0.0
+            print(f"[PLAYOUT] target={self.target_latency * 1000:.0f} ms, scheduled={self.scheduled}, "
+                  f"played={self.played}, late drops={self.late}, "
+                  f"occupancy mean={mean:.1f} max={self.occupancy_max}")
+            self.occupancy_sum = 0
+            self.occupancy_max = self.pending
+
+playout = None  # PlayoutBuffer when --playout-latency is set, else MIDI fires on arrival
+current_timetag = None  # timetag of the bundle being handled, None for plain messages
+
+def play_sample(x, y, z, device_us=None, timetag_offset_us=0, player=play_gyr):
+    # Timetags stamp the first sample of a packet; device_us is this sample's own time
+    if player is play_gyr and latest_ypr is not None:
+        # The device sends true orientation, gyro rates no longer play notes
+        return
+    if playout is None or device_us is None:
+        player(x, y, z)
+        return
+    timetag = None if current_timetag is None else current_timetag + timetag_offset_us / 1e6
+    playout.schedule(device_us, timetag, link_stats.arrival, player, x, y, z)
+
 # Patch OSC handlers to update plots
 def handle_gyr(address, *args):
-    print(f"[OSC]Gyr: {args}")
+    # /gyr: x, y, z, packet seq, device timestamp (us)
+    if verbose:
+        print(f"[OSC]Gyr: {args}")
+    if len(args) >= 5:
+        link_stats.update(args[3], args[4])
     if len(args) >= 3:
         update_gyr_plot(args[0], args[1], args[2])
-        opt = latest_opt_value if latest_opt_value is not None else 1
-        if opt == 1:
-            gyr_to_midi(args[0], args[1], args[2])
-        elif opt == 2:
-            gyr_to_midi(args[0], args[1], args[2])
-            gyr_to_cc(args[0], args[1], args[2], mode='all')
-        elif opt == 3:
-            gyr_to_cc(args[0], args[1], args[2], mode='roll')
-        elif opt == 4:
-            gyr_to_cc(args[0], args[1], args[2], mode='pitch')
-        elif opt == 5:
-            gyr_to_cc(args[0], args[1], args[2], mode='yaw')
+        play_sample(args[0], args[1], args[2], args[4] if len(args) >= 5 else None)
 
 def handle_acc(address, *args):
     global latest_acc_y
-    print(f"[OSC] Acc: {args}")
+    if verbose:
+        print(f"[OSC] Acc: {args}")
+    if len(args) >= 5:
+        link_stats.update(args[3], args[4])
     if len(args) >= 3:
         update_acc_plot(args[0], args[1], args[2])
         latest_acc_y = args[1]
 
+def handle_batch(address, *args):
+    # /batch: base timestamp (us), sample interval (us), packet seq, then ax ay az gx gy gz per sample
+    global latest_acc_y
+    if len(args) < 9:
+        return
+    base_us, interval_us = args[0], args[1]
+    link_stats.update(args[2], base_us)
+    samples = np.asarray(args[3:], dtype=np.float32)
+    samples = samples[:len(samples) - len(samples) % 6].reshape(-1, 6)
+    if verbose:
+        print(f"[OSC] Batch: {len(samples)} samples @ {interval_us} us from t={base_us} us")
+    # Every sample goes to the plots; MIDI follows the newest one, once per packet
+    append_plot_samples(samples)
+    latest_acc_y = samples[-1, 1]
+    last_offset_us = (len(samples) - 1) * interval_us
+    play_sample(*samples[-1, 3:6], device_us=base_us + last_offset_us, timetag_offset_us=last_offset_us)
+
+# /imu blob: uint32 seq, uint16 count, uint16 interval_us, then count x int16 ax..gz (little-endian).
+# ESP32_MPU_OSC sends /imu in raw counts; ESP32_MPU_LED_BUZZER_OSC sends /imu1 and /imu2
+# (one per MPU) in milli-units, mm/s^2 and mrad/s.
+IMU_BLOB_HEADER = struct.Struct("<IHH")
+IMU_BLOB_SAMPLE = 12
+
+def decode_imu_blob(blob):
+    # None if the blob is shorter than its header says
+    if len(blob) < IMU_BLOB_HEADER.size:
+        return None
+    seq, count, interval_us = IMU_BLOB_HEADER.unpack_from(blob)
+    if len(blob) < IMU_BLOB_HEADER.size + count * IMU_BLOB_SAMPLE:
+        return None
+    samples = np.frombuffer(blob, dtype="<i2", count=count * 6, offset=IMU_BLOB_HEADER.size)
+    return seq, interval_us, samples.reshape(count, 6).astype(np.float32)
+
+def read_imu_blob(address, args):
+    # /imu, /imu1, /imu2: base timestamp (us), packet seq, packed int16 blob.
+    # Counts the packet for the link stats and returns the decoded blob, or None if malformed.
+    if len(args) < 3 or not isinstance(args[2], (bytes, bytearray)):
+        return None
+    decoded = decode_imu_blob(args[2])
+    if decoded is None:
+        print(f"[OSC] Dropping truncated {address} blob ({len(args[2])} bytes)")
+        return None
+    link_stats.update(args[1], args[0])
+    return decoded
+
+def handle_imu(address, *args):
+    # /imu, and /imu1 of the two-MPU board: drives the plots and the notes
+    global latest_acc_y
+    decoded = read_imu_blob(address, args)
+    if decoded is None:
+        return
+    seq, interval_us, samples = decoded
+    if len(samples) == 0:
+        return
+    if verbose:
+        print(f"[OSC] IMU: seq={seq}, {len(samples)} samples @ {interval_us} us")
+    append_plot_samples(samples)
+    latest_acc_y = samples[-1, 1]
+    last_offset_us = (len(samples) - 1) * interval_us
+    play_sample(*samples[-1, 3:6], device_us=args[0] + last_offset_us, timetag_offset_us=last_offset_us)
+
+def handle_imu2(address, *args):
+    # /imu2: the second MPU of the two-MPU board, only counted in the link stats
+    decoded = read_imu_blob(address, args)
+    if verbose and decoded is not None:
+        print(f"[OSC] IMU2: seq={decoded[0]}, {len(decoded[2])} samples @ {decoded[1]} us")
+
+def handle_quat(address, *args):
+    # /quat: w, x, y, z, packet seq, device timestamp (us)
+    global latest_quat
+    if len(args) >= 6:
+        link_stats.update(args[4], args[5])
+    if len(args) >= 4:
+        latest_quat = tuple(args[0:4])
+
+def handle_ypr(address, *args):
+    # /ypr: yaw, pitch, roll (degrees), packet seq, device timestamp (us)
+    global latest_ypr
+    if verbose:
+        print(f"[OSC] YPR: {args}")
+    if len(args) >= 5:
+        link_stats.update(args[3], args[4])
+    if len(args) >= 3:
+        latest_ypr = tuple(args[0:3])
+        play_sample(args[0], args[1], args[2], args[4] if len(args) >= 5 else None, player=play_ypr)
+
 def handle_opt(address, *args):
     global latest_opt_value
     if args:
         latest_opt_value = args[0]
         print(f"[OSC] /opt: {latest_opt_value}")
 
-def osc_server_thread():
-    dispatcher = Dispatcher()
-    dispatcher.map("/gyr", handle_gyr)
-    dispatcher.map("/acc", handle_acc)
-    dispatcher.map("/opt", handle_opt)
-    ip = "0.0.0.0"
-    port = 8000  # Must match ESP32 sender
-    server = BlockingOSCUDPServer((ip, port), dispatcher)
-    print(f"Listening for OSC on {ip}:{port}")
-    server.serve_forever()
+# OSC address -> handler. Bundles are unpacked in order, so /acc of a sample
+# is always handled before the /gyr sharing its timetag.
+OSC_HANDLERS = {
+    "/gyr": handle_gyr,
+    "/acc": handle_acc,
+    "/opt": handle_opt,
+    "/batch": handle_batch,
+    "/imu": handle_imu,
+    "/imu1": handle_imu,
+    "/imu2": handle_imu2,
+    "/quat": handle_quat,
+    "/ypr": handle_ypr,
+}
+OSC_MAX_PACKET = 1536
+HOLD_INTERVAL = 0.05  # seconds of silence before the plots repeat the held values
+
+# /sync/pong ,hhh: the ping's device time t1, our receive time t2 and send time t3 (Unix us)
+SYNC_PONG = struct.Struct(">12s8sqqq")
+
+def sync_pong(t1, t2):
+    return SYNC_PONG.pack(b"/sync/pong", b",hhh", t1, t2, time.time_ns() // 1000)
+
+def handle_packet(data, arrival=None, reply=None):
+    global current_timetag
+    # Accepts a plain message or a (possibly nested) bundle.
+    # arrival is the wall-clock receive time; reply(bytes) answers the sender.
+    if arrival is None:
+        arrival = time.time()
+    link_stats.begin_packet(arrival)
+    try:
+        packet = OscPacket(data)
+    except ParseError as e:
+        print(f"[OSC] Dropping malformed packet: {e}")
+        return
+    # The bundle's own timetag, not TimedMessage.time (see bundle_timetag)
+    timetag = bundle_timetag(data)
+    for timed_msg in packet.messages:
+        msg = timed_msg.message
+        if msg.address == "/sync/ping":
+            # Clock sync: answer at once, before any handler can delay t3
+            if reply is not None and msg.params:
+                reply(sync_pong(msg.params[0], int(arrival * 1e6)))
+            continue
+        current_timetag = timetag
+        if timetag is not None:
+            link_stats.add_timetag(timetag)
+        handler = OSC_HANDLERS.get(msg.address)
+        if handler is not None:
+            handler(msg.address, *msg.params)
+
+def open_osc_socket(port, multicast_group=None):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    # Lets the visualizer/recorder listen on the same port on this machine
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("0.0.0.0", port))
+    if multicast_group:
+        mreq = struct.pack("4s4s", socket.inet_aton(multicast_group), socket.inet_aton("0.0.0.0"))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    return sock
+
+def osc_server_thread(port=8000, multicast_group=None):
+    # port must match the ESP32 sender (oscServerPort1 or oscMulticastPort)
+    sock = open_osc_socket(port, multicast_group)
+    if multicast_group:
+        print(f"Listening for OSC on multicast group {multicast_group}:{port}")
+    else:
+        print(f"Listening for OSC on 0.0.0.0:{port}")
+    sock.settimeout(HOLD_INTERVAL)
+    while True:
+        try:
+            data, addr = sock.recvfrom(OSC_MAX_PACKET)
+        except socket.timeout:
+            if link_stats.received:
+                hold_plot_samples()
+            continue
+        # Timestamp on arrival, before MIDI output can delay the handlers
+        handle_packet(data, time.time(), lambda payload: sock.sendto(payload, addr))
+        link_stats.maybe_report()
+        if playout is not None:
+            playout.maybe_report()
+
+# OSC 1.1 stream framing: SLIP (RFC 1055), END before and after every packet
+SLIP_END = b"\xc0"
+SLIP_ESC = b"\xdb"
+
+class SlipDecoder:
+    """Splits a byte stream into SLIP frames; bytes outside frames (boot log text) are dropped as runts."""
+
+    def __init__(self, max_frame=OSC_MAX_PACKET * 2):
+        self.buf = bytearray()
+        self.max_frame = max_frame
+
+    def feed(self, data):
+        self.buf += data
+        *frames, self.buf = self.buf.split(SLIP_END)
+        if len(self.buf) > self.max_frame:
+            self.buf = bytearray()  # no END for too long: resynchronize on the next one
+        # ESC ESC_END -> END first: it cannot create a new ESC ESC_ESC pair
+        return [bytes(f).replace(SLIP_ESC + b"\xdc", SLIP_END).replace(SLIP_ESC + b"\xdd", SLIP_ESC)
+                for f in frames if f]
+
+def serial_reader_thread(device, baud):
+    # Wired alternative to osc_server_thread for firmware built with OSC_TRANSPORT_SERIAL
+    import serial  # pyserial, only needed for --serial
+    ser = serial.Serial(device, baud, timeout=HOLD_INTERVAL)
+    print(f"Reading SLIP-framed OSC from {device} at {baud} baud")
+    decoder = SlipDecoder()
+    while True:
+        data = ser.read(max(1, ser.in_waiting))
+        if not data:
+            if link_stats.received:
+                hold_plot_samples()
+            continue
+        arrival = time.time()
+        for frame in decoder.feed(data):
+            if frame.startswith(b"/") or frame.startswith(b"#bundle"):
+                handle_packet(frame, arrival)
+        link_stats.maybe_report()
+        if playout is not None:
+            playout.maybe_report()
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="OSC (ESP32 MPU6050) to MIDI bridge")
+    parser.add_argument("--port", type=int, default=8000, help="UDP port to listen on")
+    parser.add_argument("--multicast", metavar="GROUP", default=None,
+                        help="join this multicast group (e.g. 239.0.0.57) instead of plain unicast")
+    parser.add_argument("--serial", metavar="DEVICE", default=None,
+                        help="read SLIP-framed OSC from this serial port (e.g. /dev/ttyUSB0, COM5) instead of UDP")
+    parser.add_argument("--baud", type=int, default=921600, help="serial baud rate (must match OSC_SERIAL_BAUD)")
+    parser.add_argument("--playout-latency", metavar="MS", type=float, default=0,
+                        help="play MIDI at device time + MS (e.g. 20) to absorb network jitter; 0 plays on arrival")
+    parser.add_argument("--min-note-interval", metavar="MS", type=float, default=MIN_NOTE_INTERVAL * 1000,
+                        help="drop notes closer together than MS, whatever the sample rate")
+    parser.add_argument("--verbose", action="store_true", help="print every OSC message received")
+    return parser.parse_args()
 
 def main():
-    # Start OSC server in a separate thread
-    osc_thread = threading.Thread(target=osc_server_thread, daemon=True)
+    global playout, verbose, MIN_NOTE_INTERVAL
+    args = parse_args()
+    verbose = args.verbose
+    MIN_NOTE_INTERVAL = args.min_note_interval / 1000.0
+    if args.playout_latency > 0:
+        playout = PlayoutBuffer(midi_scheduler, args.playout_latency / 1000.0)
+    # Start OSC server (or serial reader) in a separate thread
+    if args.serial:
+        osc_thread = threading.Thread(target=serial_reader_thread, args=(args.serial, args.baud), daemon=True)
+    else:
+        osc_thread = threading.Thread(target=osc_server_thread, args=(args.port, args.multicast), daemon=True)
     osc_thread.start()
     # Start plot window in main thread
     plot_window()
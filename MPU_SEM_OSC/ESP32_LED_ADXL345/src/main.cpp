@@ -2,6 +2,7 @@
 #include <Wire.h>
 #include <Adafruit_Sensor.h>
 #include <Adafruit_ADXL345_U.h>
+#include <Preferences.h>
 
 // pin 0 is the WS2812B input signal from the led strip
 const unsigned char LED_CONNECTION_PIN = 2;
@@ -14,16 +15,80 @@ const unsigned char STARTING_LED_SECTION_1 = 0;
 const unsigned char STARTING_LED_SECTION_2 = 3;
 const unsigned char STARTING_LED_SECTION_3 = 6;
 const unsigned char STARTING_LED_SECTION_4 = 9;
+// ADXL345 INT1 is wired to this pin; the FIFO watermark and the motion/tap events wake loop()
+const unsigned char ACCEL_INT_PIN = 4;
+const uint8_t ACCEL_I2C_ADDRESS = 0x53;
+// Tap detection needs at least 100 Hz; the FIFO keeps the MCU from waking for every sample
+const dataRate_t ACCEL_DATA_RATE = ADXL345_DATARATE_100_HZ;
+// Samples queued before the watermark interrupt, i.e. a loop() pass every 100 ms (the FIFO holds 32)
+const uint8_t ACCEL_FIFO_WATERMARK = 10;
+// Every source shares INT1 and stays high until served, so an event that lands while another
+// is pending raises no new edge; after this long loop() serves them anyway
+const unsigned long ACCEL_TIMEOUT_MS = 200;
+// Full resolution keeps 4 mg per count at every range
+const float ACCEL_G_PER_LSB = 0.004;
+// Event detection done by the sensor itself
+const uint8_t ACCEL_TAP_THRESHOLD = 48;    // 62.5 mg/LSB: 3 g
+const uint8_t ACCEL_TAP_DURATION = 16;     // 625 us/LSB: shorter than 10 ms
+const uint8_t ACCEL_TAP_LATENCY = 16;      // 1.25 ms/LSB: 20 ms quiet before the second tap
+const uint8_t ACCEL_TAP_WINDOW = 160;      // 1.25 ms/LSB: the second tap within 200 ms
+// SINGLE_TAP comes with the first tap, before a double tap is known; it only counts once this has passed
+const unsigned long ACCEL_DOUBLE_TAP_MS = (ACCEL_TAP_LATENCY + ACCEL_TAP_WINDOW) * 5UL / 4;
+const uint8_t ACCEL_ACT_THRESHOLD = 8;     // 62.5 mg/LSB: 0.5 g change, e.g. braking
+const uint8_t ACCEL_INACT_THRESHOLD = 4;   // 62.5 mg/LSB: 0.25 g
+const uint8_t ACCEL_INACT_TIME = 1;        // s below it before inactivity
+// ADXL345 registers and INT_ENABLE / INT_SOURCE bits the Adafruit driver has no names for
+const uint8_t ACCEL_REG_THRESH_TAP = 0x1D;
+const uint8_t ACCEL_REG_DUR = 0x21;
+const uint8_t ACCEL_REG_LATENT = 0x22;
+const uint8_t ACCEL_REG_WINDOW = 0x23;
+const uint8_t ACCEL_REG_THRESH_ACT = 0x24;
+const uint8_t ACCEL_REG_THRESH_INACT = 0x25;
+const uint8_t ACCEL_REG_TIME_INACT = 0x26;
+const uint8_t ACCEL_REG_ACT_INACT_CTL = 0x27;
+const uint8_t ACCEL_REG_TAP_AXES = 0x2A;
+const uint8_t ACCEL_FIFO_STREAM = 0x80;
+const uint8_t ACCEL_POWER_LINK = 0x20;
+const uint8_t ACCEL_POWER_MEASURE = 0x08;
+const uint8_t ACCEL_INT_SINGLE_TAP = 0x40;
+const uint8_t ACCEL_INT_DOUBLE_TAP = 0x20;
+const uint8_t ACCEL_INT_ACTIVITY = 0x10;
+const uint8_t ACCEL_INT_INACTIVITY = 0x08;
+const uint8_t ACCEL_INT_WATERMARK = 0x02;
+TaskHandle_t loop_task = NULL;
+// Zero offsets are measured while the board lies flat and still, then kept in NVS
+const char* ACCEL_CAL_NAMESPACE = "imu-cal";
+const char* ACCEL_CAL_KEY = "adxl345";
+const int ACCEL_CAL_SAMPLES = 200; // 2 s at 100 Hz
+const float ACCEL_CAL_MAX_SPREAD = 1.0; // m/s^2 between extremes on any axis, or it moved
+const float ACCEL_CAL_MAX_ERROR = 2.0; // m/s^2 (about 0.2 g) from 0, 0, +1 g on any axis, or it is not flat
+const unsigned char ACCEL_CAL_MAX_EMPTY_WAKEUPS = 10; // in a row without a sample, or it left the bus
+const float ACCEL_OFFSET_G_PER_LSB = 0.0156; // OFSX/OFSY/OFSZ scale at any range
 short iteration = 0; // used by the for loops. Will use only this one to reserve memory and all the for loops will run separately
-short delay_val = 50;
 bool is_on = false;
-bool do_turn_signal = true;
+bool do_turn_signal = false;
+bool is_braking = false; // between an activity and an inactivity interrupt
+bool is_beam_on = false; // toggled by a double tap
+bool is_single_tap_pending = false; // until ACCEL_DOUBLE_TAP_MS tells it from a double tap
+unsigned long single_tap_ms = 0;
+float accel_module = 0; // of the newest sample, kept across wake-ups that only bring events
 unsigned char signal_step = 0;
 short test_frame = 0;
 
 /* Assign a unique ID to this sensor at the same time */
 Adafruit_ADXL345_Unified accel = Adafruit_ADXL345_Unified(12345);
 
+/*
+INT1 of the ADXL345: wakes loop() once the FIFO reaches the watermark or on a motion/tap event
+*/
+void IRAM_ATTR accel_interrupt(){
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loop_task, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
 /*
 This method will light all the leds related to the brake light, 
 which are the leds 0,1,2 | 3,4,5 | 12
@@ -153,19 +218,176 @@ void test_lights_states(){
   }
 }
 
+/*
+Writes the zero offsets into OFSX, OFSY, OFSZ; the ADXL345 adds them to
+every sample itself, so loop() reads calibrated data at no extra cost.
+The registers are cleared at power-up, hence the copy in NVS.
+*/
+void write_accel_offsets(const int8_t offsets[3]){
+  accel.writeRegister(ADXL345_REG_OFSX, (uint8_t)offsets[0]);
+  accel.writeRegister(ADXL345_REG_OFSY, (uint8_t)offsets[1]);
+  accel.writeRegister(ADXL345_REG_OFSZ, (uint8_t)offsets[2]);
+}
+
+bool load_accel_calibration(){
+  int8_t offsets[3];
+  Preferences prefs;
+  prefs.begin(ACCEL_CAL_NAMESPACE, true);
+  bool found = prefs.getBytesLength(ACCEL_CAL_KEY) == sizeof(offsets) &&
+               prefs.getBytes(ACCEL_CAL_KEY, offsets, sizeof(offsets)) == sizeof(offsets);
+  prefs.end();
+  if (found) {
+    write_accel_offsets(offsets);
+  }
+  return found;
+}
+
+/*
+Reads every sample queued in the FIFO, at most max_samples, into samples.
+Each FIFO entry is one 6-byte burst of DATAX0..DATAZ1: the FIFO only moves
+on once all three axes have been read in the same transaction.
+*/
+uint8_t drain_accel_fifo(sensors_event_t* samples, uint8_t max_samples){
+  uint8_t entries = accel.readRegister(ADXL345_REG_FIFO_STATUS) & 0x3F;
+  if (entries > max_samples) {
+    entries = max_samples;
+  }
+  uint8_t count = 0;
+  for (; count < entries; count++) {
+    Wire.beginTransmission(ACCEL_I2C_ADDRESS);
+    Wire.write(ADXL345_REG_DATAX0);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(ACCEL_I2C_ADDRESS, (uint8_t)6) != 6) {
+      break;
+    }
+    uint8_t buffer[6];
+    for (unsigned char i = 0; i < 6; i++) {
+      buffer[i] = Wire.read();
+    }
+    const float scale = ACCEL_G_PER_LSB * SENSORS_GRAVITY_STANDARD;
+    samples[count].acceleration.x = (int16_t)(buffer[0] | (buffer[1] << 8)) * scale;
+    samples[count].acceleration.y = (int16_t)(buffer[2] | (buffer[3] << 8)) * scale;
+    samples[count].acceleration.z = (int16_t)(buffer[4] | (buffer[5] << 8)) * scale;
+  }
+  return count;
+}
+
+/*
+Sets up the FIFO in stream mode and the sensor's own tap and activity
+detection, all signalled on INT1 (active high).
+*/
+void setup_accel_events(){
+  accel.writeRegister(ACCEL_REG_THRESH_TAP, ACCEL_TAP_THRESHOLD);
+  accel.writeRegister(ACCEL_REG_DUR, ACCEL_TAP_DURATION);
+  accel.writeRegister(ACCEL_REG_LATENT, ACCEL_TAP_LATENCY);
+  accel.writeRegister(ACCEL_REG_WINDOW, ACCEL_TAP_WINDOW);
+  accel.writeRegister(ACCEL_REG_TAP_AXES, 0x07);
+  accel.writeRegister(ACCEL_REG_THRESH_ACT, ACCEL_ACT_THRESHOLD);
+  accel.writeRegister(ACCEL_REG_THRESH_INACT, ACCEL_INACT_THRESHOLD);
+  accel.writeRegister(ACCEL_REG_TIME_INACT, ACCEL_INACT_TIME);
+  // AC-coupled on every axis, so gravity and tilt do not count as activity
+  accel.writeRegister(ACCEL_REG_ACT_INACT_CTL, 0xFF);
+  // Linked: activity is only looked for after an inactivity and referenced to the
+  // acceleration at that point, so a new resting tilt ends in inactivity instead of
+  // re-asserting activity, and the two events alternate. Changed in standby.
+  accel.writeRegister(ADXL345_REG_POWER_CTL, 0x00);
+  accel.writeRegister(ADXL345_REG_POWER_CTL, ACCEL_POWER_LINK | ACCEL_POWER_MEASURE);
+  accel.writeRegister(ADXL345_REG_FIFO_CTL, ACCEL_FIFO_STREAM | ACCEL_FIFO_WATERMARK);
+  accel.writeRegister(ADXL345_REG_INT_MAP, 0x00);
+  accel.writeRegister(ADXL345_REG_INT_ENABLE,
+    ACCEL_INT_SINGLE_TAP | ACCEL_INT_DOUBLE_TAP | ACCEL_INT_ACTIVITY | ACCEL_INT_INACTIVITY | ACCEL_INT_WATERMARK);
+}
+
+/*
+Averages ACCEL_CAL_SAMPLES samples with the board flat and still, where it
+should read 0, 0, +1 g, and stores the offsets that make it so.
+Nothing changes if it moved meanwhile, is not lying flat with +Z up or
+stops delivering samples.
+*/
+bool calibrate_accel(){
+  Serial.println("Calibrating ADXL345, keep it flat and still");
+  int8_t offsets[3] = {0, 0, 0};
+  write_accel_offsets(offsets);
+  // Whatever was queued still has the old offsets
+  accel.writeRegister(ADXL345_REG_FIFO_CTL, 0x00);
+  accel.writeRegister(ADXL345_REG_FIFO_CTL, ACCEL_FIFO_STREAM | ACCEL_FIFO_WATERMARK);
+  float sum[3] = {0, 0, 0};
+  float low[3], high[3];
+  sensors_event_t samples[32];
+  unsigned char empty_wakeups = 0;
+  iteration = 0;
+  while (iteration < ACCEL_CAL_SAMPLES) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ACCEL_TIMEOUT_MS));
+    accel.readRegister(ADXL345_REG_INT_SOURCE); // taps and activity are not acted on meanwhile
+    uint8_t count = drain_accel_fifo(samples, sizeof(samples) / sizeof(samples[0]));
+    if (count > 0) {
+      empty_wakeups = 0;
+    } else if (++empty_wakeups >= ACCEL_CAL_MAX_EMPTY_WAKEUPS) {
+      Serial.println("ADXL345 stopped sending samples, offsets unchanged");
+      load_accel_calibration();
+      return false;
+    }
+    for (uint8_t n = 0; n < count && iteration < ACCEL_CAL_SAMPLES; n++, iteration++) {
+      float v[3] = {samples[n].acceleration.x, samples[n].acceleration.y, samples[n].acceleration.z};
+      for (unsigned char i = 0; i < 3; i++) {
+        sum[i] += v[i];
+        if (iteration == 0 || v[i] < low[i]) low[i] = v[i];
+        if (iteration == 0 || v[i] > high[i]) high[i] = v[i];
+      }
+    }
+  }
+  float expected[3] = {0, 0, SENSORS_GRAVITY_STANDARD};
+  for (unsigned char i = 0; i < 3; i++) {
+    if (high[i] - low[i] > ACCEL_CAL_MAX_SPREAD) {
+      Serial.println("ADXL345 moved during calibration, offsets unchanged");
+      load_accel_calibration();
+      return false;
+    }
+    float error = sum[i] / ACCEL_CAL_SAMPLES - expected[i];
+    if (fabsf(error) > ACCEL_CAL_MAX_ERROR) {
+      Serial.println("ADXL345 is not flat with +Z up, offsets unchanged");
+      load_accel_calibration();
+      return false;
+    }
+    float error_g = error / SENSORS_GRAVITY_STANDARD;
+    offsets[i] = (int8_t)constrain(lroundf(-error_g / ACCEL_OFFSET_G_PER_LSB), -128, 127);
+  }
+  write_accel_offsets(offsets);
+  Preferences prefs;
+  prefs.begin(ACCEL_CAL_NAMESPACE, false);
+  prefs.putBytes(ACCEL_CAL_KEY, offsets, sizeof(offsets));
+  prefs.end();
+  Serial.printf("ADXL345 offsets: %d %d %d\n", offsets[0], offsets[1], offsets[2]);
+  return true;
+}
+
 void setup() {
   #ifndef ESP8266
     while (!Serial); // for Leonardo/Micro/Zero
   #endif
   Serial.begin(9600);
   /* Initialise the sensor */
-  if(!accel.begin())
+  if(!accel.begin(ACCEL_I2C_ADDRESS))
   {
     /* There was a problem detecting the ADXL345 ... check your connections */
     Serial.println("Ooops, no ADXL345 detected ... Check your wiring!");
     while(1);
   }
   accel.setRange(ADXL345_RANGE_16_G);
+  accel.setDataRate(ACCEL_DATA_RATE);
+
+  // FIFO watermark and events on INT1, waking the task that runs loop()
+  loop_task = xTaskGetCurrentTaskHandle();
+  pinMode(ACCEL_INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(ACCEL_INT_PIN), accel_interrupt, RISING);
+  setup_accel_events();
+
+  // Stored offsets go straight back into the sensor; measuring them needs a "c" with the board flat
+  if (load_accel_calibration()) {
+    Serial.println("ADXL345 calibration loaded");
+  }
+  else {
+    Serial.println("ADXL345 not calibrated, send \"c\" with it flat and still");
+  }
 
   // initialize the pixels instance
   pixels.begin();
@@ -176,8 +398,8 @@ void setup() {
   Serial.println("");
 }
 
-double get_accel_vector_module(sensors_event_t& p_event){
-  return sqrt(
+float get_accel_vector_module(sensors_event_t& p_event){
+  return sqrtf(
       (p_event.acceleration.x*p_event.acceleration.x)
       +(p_event.acceleration.y*p_event.acceleration.y)
       +(p_event.acceleration.z*p_event.acceleration.z)
@@ -186,13 +408,62 @@ double get_accel_vector_module(sensors_event_t& p_event){
 
 // the loop routine runs over and over again forever:
 void loop() {
-  /* Get a new sensor event */ 
-  sensors_event_t event; 
-  accel.getEvent(&event);
-  
+  /* "c" on the serial port recalibrates */
+  if (Serial.available() && Serial.read() == 'c') {
+    calibrate_accel();
+  }
+
+  /* Sleep until the FIFO fills up to the watermark or the sensor detects an event */
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ACCEL_TIMEOUT_MS));
+
+  /* Reading INT_SOURCE clears the tap and activity events */
+  uint8_t events = accel.readRegister(ADXL345_REG_INT_SOURCE);
+  // Linked events alternate, so both in one read went there and back again
+  uint8_t motion = events & (ACCEL_INT_ACTIVITY | ACCEL_INT_INACTIVITY);
+  if (motion == ACCEL_INT_ACTIVITY) {
+    is_braking = true;
+  }
+  else if (motion == ACCEL_INT_INACTIVITY) {
+    is_braking = false;
+  }
+  if (events & ACCEL_INT_DOUBLE_TAP) {
+    is_beam_on = !is_beam_on;
+    is_single_tap_pending = false; // its first tap, usually seen in an earlier read
+  }
+  else if (events & ACCEL_INT_SINGLE_TAP) {
+    is_single_tap_pending = true;
+    single_tap_ms = millis();
+  }
+  if (is_single_tap_pending && millis() - single_tap_ms >= ACCEL_DOUBLE_TAP_MS) {
+    is_single_tap_pending = false;
+    do_turn_signal = true;
+    signal_step = 0;
+  }
+
+  /* Drain the FIFO in one go; the newest sample is shown */
+  sensors_event_t samples[32];
+  uint8_t count = drain_accel_fifo(samples, sizeof(samples) / sizeof(samples[0]));
+
   pixels.clear();
   test_frame++;
-  show_led_accel(round(get_accel_vector_module(event)));
+  if (is_beam_on) {
+    light_beam();
+  }
+  if (is_braking) {
+    brake_light();
+  }
+  if (do_turn_signal) {
+    turn_signal(signal_step);
+    signal_step++;
+    if (signal_step >= LED_SECTION_SIZE) {
+      signal_step = 0;
+      do_turn_signal = false;
+    }
+  }
+  if (count > 0) {
+    accel_module = get_accel_vector_module(samples[count - 1]);
+  }
+  show_led_accel(round(accel_module));
   pixels.show();
   if(is_on){
     digitalWrite(INBOARD_LED_PIN, LOW);   // turn the LED off by making the voltage LOW
@@ -200,8 +471,6 @@ void loop() {
   else{
     digitalWrite(INBOARD_LED_PIN, HIGH);  // turn the LED on (HIGH is the voltage level)
   }
-
-  delay(delay_val);
 }
 
 //void change_state(){